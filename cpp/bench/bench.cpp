@@ -0,0 +1,257 @@
+// papr - bench.cpp
+// Throughput of the tokenizer, validator, tape builders, tape walks, lookups,
+// diff and serializers over generated corpora, for every scanner backend the
+// CPU supports.
+//
+// The benchmark has no dependencies beyond the papr headers. From cpp/:
+//
+//   c++ -std=c++20 -O3 -march=native -Iinclude bench/bench.cpp -o papr_bench -pthread
+//
+//   ./papr_bench                   every shape, both forms, 16 MB each
+//   ./papr_bench --size 64         corpora of 64 MB
+//   ./papr_bench --shape records   one shape only
+//   ./papr_bench --write corpus    also write each corpus to corpus/<shape>-<form>.papr
+//
+// Every figure is the best of several timed runs of at least --time seconds
+// (default 0.25). MB/s counts input bytes, or output bytes for the
+// serializers; tokens/s counts nodes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <papr/papr.hpp>
+
+#include "corpus.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_per_run = 0.25;
+constexpr int rounds = 5;
+
+// Keeps the optimizer from dropping a result.
+template <class T>
+void keep(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs `body` repeatedly and returns the best time of one run, in seconds.
+template <class Body>
+double best_time(Body&& body) {
+  double best = 1e30;
+  for (int round = 0; round < rounds; ++round) {
+    std::size_t runs = 0;
+    const auto start = clock_type::now();
+    double elapsed = 0;
+    do {
+      body();
+      ++runs;
+      elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+    } while (elapsed < seconds_per_run / rounds);
+    best = std::min(best, elapsed / static_cast<double>(runs));
+  }
+  return best;
+}
+
+void report(const char* corpus, const char* what, const char* backend_name, double seconds,
+            std::size_t bytes, std::size_t items, const char* unit = "tokens/s") {
+  char throughput[32] = "-";
+  if (bytes > 0)
+    std::snprintf(throughput, sizeof throughput, "%.1f MB/s",
+                  static_cast<double>(bytes) / seconds / 1e6);
+  std::printf("%-18s %-12s %-7s %15s %12.3g %s\n", corpus, what, backend_name, throughput,
+              static_cast<double>(items) / seconds, unit);
+}
+
+void bench_corpus(const char* name, const std::string& text) {
+  papr::document doc;
+  if (const papr::status st = papr::parse(text, doc); !st.ok()) {
+    std::printf("%-18s does not parse: %s at %zu\n", name, papr::to_string(st.code), st.offset);
+    return;
+  }
+  const std::size_t tokens = doc.size();
+
+  for (const papr::backend b : {papr::backend::scalar, papr::backend::sse2,
+                                papr::backend::avx2, papr::backend::neon}) {
+    if (!papr::is_supported(b)) continue;
+    const char* backend_name = papr::to_string(b);
+
+    const double lex = best_time([&] {
+      papr::tokenizer tok{text, b};
+      std::size_t n = 0;
+      for (papr::token t = tok.next(); t.kind != papr::token_kind::end; t = tok.next()) ++n;
+      keep(n);
+    });
+    report(name, "tokenize", backend_name, lex, text.size(), tokens);
+
+    const double check = best_time([&] { keep(papr::validate(text, b).ok()); });
+    report(name, "validate", backend_name, check, text.size(), tokens);
+
+    papr::parser reused{papr::arena::default_block_size, b};
+    const double build = best_time([&] { keep(reused.parse(text)); });
+    report(name, "build", backend_name, build, text.size(), tokens);
+  }
+
+  papr::parallel_options options;
+  options.min_chunk_size = text.size() / 8 + 1;
+  papr::document parallel_doc;
+  const double parallel =
+      best_time([&] { keep(papr::parse_parallel(text, parallel_doc, options)); });
+  report(name, "build-mt", "auto", parallel, text.size(), tokens);
+
+  papr::parser hashing;
+  hashing.set_hash_subtrees(true);
+  const double hashed = best_time([&] { keep(hashing.parse(text)); });
+  report(name, "build-hashed", "auto", hashed, text.size(), tokens);
+  papr::compact_document compact;
+  const double compact_build = best_time([&] { keep(papr::parse(text, compact)); });
+  report(name, "compact", "auto", compact_build, text.size(), tokens);
+  papr::lazy_document lazy;
+  const double lazy_open = best_time([&] { keep(lazy.open(text)); });
+  report(name, "lazy-open", "auto", lazy_open, text.size(), tokens);
+
+  // One pass over every node of each tape.
+  const auto walk = [](const auto& tape) {
+    std::uint64_t sum = 0;
+    for (const auto& n : tape.nodes()) sum += n.length + n.next;
+    keep(sum);
+  };
+  const double walk_tape = best_time([&] { walk(doc); });
+  report(name, "walk", "-", walk_tape, 0, tokens);
+  const double walk_compact = best_time([&] { walk(compact); });
+  report(name, "walk-compact", "-", walk_compact, 0, tokens);
+
+  // The patch between the corpus and a copy with one token changed in the
+  // middle, both hashed while parsing.
+  std::string edited = text;
+  if (tokens > 0) edited.insert(static_cast<std::size_t>(doc[tokens / 2].offset), 1, 'z');
+  papr::parser other;
+  other.set_hash_subtrees(true);
+  if (tokens > 0 && hashing.parse(text).ok() && other.parse(edited).ok()) {
+    const double diff = best_time([&] { keep(papr::diff(hashing.doc(), other.doc()).empty()); });
+    report(name, "diff", "-", diff, text.size(), tokens);
+    const double verified = best_time(
+        [&] { keep(papr::diff(hashing.doc(), other.doc(), {.verify = true}).empty()); });
+    report(name, "diff-verify", "-", verified, text.size(), tokens);
+  }
+  // Every top-level key renamed, so no child matches its old neighbour and
+  // each one is looked up among its old siblings.
+  std::string renamed = text;
+  for (std::size_t i = doc.size(); i-- > 0;)
+    if (doc[i].depth == 0) renamed.insert(static_cast<std::size_t>(doc[i].offset), 1, 'z');
+  if (tokens > 0 && hashing.parse(text).ok() && other.parse(renamed).ok()) {
+    const double diff = best_time([&] { keep(papr::diff(hashing.doc(), other.doc()).empty()); });
+    report(name, "diff-renamed", "-", diff, text.size(), tokens);
+  }
+
+  // A sibling inserted in the middle and removed again, each edit re-parsed
+  // incrementally: on a plain document, one with a key index and an interned
+  // one. Every node after the edit is renumbered.
+  if (tokens > 0) {
+    const std::size_t at = papr::detail::token_begin(doc[tokens / 2]);
+    std::string grown = text;
+    grown.insert(at, "zz,");
+    const auto reparse_time = [&](papr::document& edited) {
+      return best_time([&] {
+        keep(papr::reparse(edited, grown, {at, 0, 3}));
+        keep(papr::reparse(edited, text, {at, 3, 0}));
+      }) / 2;
+    };
+    papr::document plain, indexed, interned;
+    if (papr::parse(text, plain).ok() && papr::parse(text, indexed).ok() &&
+        papr::parse(text, interned).ok()) {
+      indexed.build_index();
+      interned.intern();
+      report(name, "reparse", "-", reparse_time(plain), text.size(), tokens);
+      report(name, "reparse-idx", "-", reparse_time(indexed), text.size(), tokens);
+      report(name, "reparse-sym", "-", reparse_time(interned), text.size(), tokens);
+    }
+  }
+
+  // Lookups: every depth-0 key and the children of the first few, first by
+  // sibling scan and then through the key index.
+  std::vector<std::pair<std::size_t, std::string>> keys;
+  for (std::size_t i = 0; i < doc.size() && keys.size() < 4096;) {
+    keys.emplace_back(papr::element::root_index, std::string(doc.value(i)));
+    const std::size_t end = doc.children_end(i);
+    for (std::size_t c = doc.children_begin(i); c < end && keys.size() < 4096;
+         c = static_cast<std::size_t>(doc[c].next))
+      keys.emplace_back(i, std::string(doc.value(c)));
+    i = end;
+  }
+  const auto lookups = [&] {
+    std::size_t found = 0;
+    for (const auto& [parent, key] : keys)
+      found += doc.find_child(parent, key) != papr::element::root_index;
+    keep(found);
+  };
+  report(name, "lookup-scan", "-", best_time(lookups), 0, keys.size(), "lookups/s");
+  const double index = best_time([&] { doc.build_index(); });
+  report(name, "index-build", "-", index, text.size(), tokens);
+  report(name, "lookup-index", "-", best_time(lookups), 0, keys.size(), "lookups/s");
+
+  papr::output_buffer out;
+  const double minify = best_time([&] {
+    out.clear();
+    papr::minify(doc, out);
+    keep(out.size());
+  });
+  report(name, "minify", "-", minify, out.size(), tokens);
+  std::string laid_out;
+  const double pretty = best_time([&] {
+    laid_out = papr::pretty(doc);
+    keep(laid_out.size());
+  });
+  report(name, "pretty", "-", pretty, laid_out.size(), tokens);
+}
+
+bool write_file(const std::string& path, const std::string& text) {
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (f == nullptr) return false;
+  const bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+  return std::fclose(f) == 0 && ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::size_t megabytes = 16;
+  const char* only = nullptr;
+  const char* write_dir = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--size" && i + 1 < argc) megabytes = std::strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--shape" && i + 1 < argc) only = argv[++i];
+    else if (arg == "--write" && i + 1 < argc) write_dir = argv[++i];
+    else if (arg == "--time" && i + 1 < argc) seconds_per_run = std::strtod(argv[++i], nullptr);
+    else {
+      std::fprintf(stderr, "usage: %s [--size MB] [--shape NAME] [--write DIR] [--time S]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  std::printf("%-18s %-12s %-7s %15s %21s\n", "corpus", "step", "backend", "throughput",
+              "rate");
+  for (const papr::bench::shape s : papr::bench::all_shapes) {
+    if (only != nullptr && std::string_view(only) != papr::bench::to_string(s)) continue;
+    for (const bool pretty : {false, true}) {
+      const std::string name =
+          std::string(papr::bench::to_string(s)) + (pretty ? "-pretty" : "-minified");
+      const std::string text = papr::bench::generate({s, megabytes << 20, pretty});
+      if (write_dir != nullptr && !write_file(std::string(write_dir) + "/" + name + ".papr", text))
+        std::fprintf(stderr, "could not write %s/%s.papr\n", write_dir, name.c_str());
+      bench_corpus(name.c_str(), text);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,205 @@
+// papr - corpus.hpp
+// Generates papr text of a chosen size and shape for benchmarking.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <papr/papr.hpp>
+
+namespace papr::bench {
+
+// Each shape leans on one part of the spec.
+enum class shape : std::uint8_t {
+  wide,     // a long flat list of `key: value;` pairs (Rules 1 and 3)
+  deep,     // chains of `:` nested hundreds of levels deep (Rule 1)
+  arrays,   // long `,` lists of numbers (Rule 2)
+  quoted,   // quoted keys and values full of `\"` escapes (Rule 4)
+  comments, // records with `#` and `##` comments between tokens (Rule 5)
+  records,  // lists of small records like the README's Buttons
+};
+
+inline constexpr shape all_shapes[] = {shape::wide,   shape::deep,     shape::arrays,
+                                       shape::quoted, shape::comments, shape::records};
+
+constexpr const char* to_string(shape s) noexcept {
+  switch (s) {
+    case shape::wide: return "wide";
+    case shape::deep: return "deep";
+    case shape::arrays: return "arrays";
+    case shape::quoted: return "quoted";
+    case shape::comments: return "comments";
+    case shape::records: return "records";
+  }
+  return "unknown";
+}
+
+struct corpus_options {
+  shape kind = shape::records;
+  std::size_t size = 1 << 20; // stop once the text is at least this long
+  bool pretty = false;        // the README's aligned layout instead of minified
+  std::uint64_t seed = 1;
+};
+
+namespace detail {
+
+// A tiny deterministic generator, so a corpus is reproducible from its seed.
+class random {
+public:
+  explicit random(std::uint64_t seed) noexcept : state_(seed) {}
+
+  std::uint64_t next() noexcept { return papr::detail::mix(state_ += papr::detail::hash_k0); }
+  std::size_t below(std::size_t n) noexcept { return static_cast<std::size_t>(next() % n); }
+
+private:
+  std::uint64_t state_;
+};
+
+inline constexpr std::string_view words[] = {
+    "alpha", "bravo",  "charlie", "delta", "echo",   "foxtrot", "golf",  "hotel",
+    "india", "juliet", "kilo",    "lima",  "mike",   "november", "oscar", "papa",
+    "quebec", "romeo", "sierra",  "tango", "uniform", "victor",  "whiskey", "xray"};
+
+// Writes the minified form token by token; comments, when enabled, go after
+// delimiters where they cannot change how the text parses.
+class emitter {
+public:
+  emitter(random& rng, bool comments) noexcept : rng_(rng), comments_(comments) {}
+
+  void token(std::string_view value) { write_token(out_, value); }
+  void open() { delimiter(":"); }
+  void sibling() { delimiter(","); }
+  void close(std::size_t levels) {
+    for (std::size_t i = 0; i < levels; ++i) delimiter(";");
+  }
+
+  std::string_view word() noexcept { return words[rng_.below(std::size(words))]; }
+  std::size_t size() const noexcept { return out_.size(); }
+  std::string release() noexcept { return out_.release(); }
+
+private:
+  void delimiter(std::string_view d) {
+    out_.write(d);
+    if (!comments_) return;
+    switch (rng_.below(4)) {
+      case 0: out_.write(" # a line comment after a delimiter\n"); break;
+      case 1: out_.write("## a block comment, with ; and : inside ##"); break;
+      default: break;
+    }
+  }
+
+  output_buffer out_;
+  random& rng_;
+  bool comments_;
+};
+
+inline void wide_entry(emitter& out, std::size_t i) {
+  out.token(std::string(out.word()) + std::to_string(i));
+  out.open();
+  out.token(out.word());
+  out.close(1);
+}
+
+inline void deep_entry(emitter& out, std::size_t i) {
+  constexpr std::size_t levels = 256;
+  out.token("chain" + std::to_string(i));
+  for (std::size_t d = 0; d < levels; ++d) {
+    out.open();
+    out.token(out.word());
+  }
+  out.close(levels);
+}
+
+inline void array_entry(emitter& out, random& rng, std::size_t i) {
+  out.token("series" + std::to_string(i));
+  out.open();
+  for (std::size_t k = 0; k < 1000; ++k) {
+    if (k > 0) out.sibling();
+    out.token(std::to_string(static_cast<std::int64_t>(rng.below(2000000)) - 1000000));
+  }
+  out.close(1);
+}
+
+inline void quoted_entry(emitter& out, std::size_t i) {
+  out.token("key \"" + std::to_string(i) + "\": " + std::string(out.word()));
+  out.open();
+  out.token("a \"quoted\" value; with, delimiters: and a \\ backslash");
+  out.sibling();
+  out.token(std::string(" padded ") + std::string(out.word()) + " ");
+  out.close(1);
+}
+
+inline void record_entry(emitter& out, random& rng, std::size_t i) {
+  out.token(std::to_string(i));
+  out.open();
+  out.token("id");
+  out.open();
+  out.token(out.word());
+  out.close(1);
+  if (rng.below(3) != 0) {
+    out.token("fn");
+    out.open();
+    out.token(std::string(out.word()) + "()");
+    out.close(1);
+  }
+  out.token("icon");
+  out.open();
+  out.token(out.word());
+  out.close(2);
+}
+
+// Inserts comments into the pretty layout. Its line breaks only ever follow
+// a delimiter or the last token, so a comment can go at the end or the start
+// of any line.
+inline std::string comment_lines(std::string_view text, random& rng) {
+  std::string out;
+  out.reserve(text.size() + text.size() / 2);
+  for (std::size_t begin = 0; begin < text.size();) {
+    const std::size_t eol = text.find('\n', begin);
+    const std::size_t end = eol == std::string_view::npos ? text.size() : eol;
+    if (rng.below(4) == 0) out += "## block ##";
+    out += text.substr(begin, end - begin);
+    if (rng.below(4) == 0) out += "  # trailing comment";
+    if (eol == std::string_view::npos) break;
+    out += '\n';
+    begin = eol + 1;
+  }
+  return out;
+}
+
+} // namespace detail
+
+// Generates a corpus. The pretty form is the minified one laid out by
+// papr::pretty, so both forms hold the same document.
+inline std::string generate(const corpus_options& options) {
+  detail::random rng{options.seed};
+  const bool comments = options.kind == shape::comments;
+  detail::emitter out{rng, comments && !options.pretty};
+  const bool records = options.kind == shape::records || options.kind == shape::comments;
+  if (records) {
+    out.token("Buttons");
+    out.open();
+  }
+  for (std::size_t i = 0; out.size() < options.size; ++i) {
+    switch (options.kind) {
+      case shape::wide: detail::wide_entry(out, i); break;
+      case shape::deep: detail::deep_entry(out, i); break;
+      case shape::arrays: detail::array_entry(out, rng, i); break;
+      case shape::quoted: detail::quoted_entry(out, i); break;
+      case shape::comments:
+      case shape::records: detail::record_entry(out, rng, i); break;
+    }
+  }
+  if (records) out.close(1);
+  std::string text = out.release();
+  if (!options.pretty) return text;
+
+  document doc;
+  if (!parse(text, doc).ok()) return {};
+  std::string laid_out = pretty(doc);
+  return comments ? detail::comment_lines(laid_out, rng) : laid_out;
+}
+
+} // namespace papr::bench
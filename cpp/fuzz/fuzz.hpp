@@ -0,0 +1,58 @@
+// papr - fuzz.hpp
+// Shared pieces of the fuzz harnesses.
+//
+// Each harness defines LLVMFuzzerTestOneInput and builds with libFuzzer, or
+// with AFL++ through its libFuzzer compatibility. From cpp/:
+//
+//   clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -Iinclude
+//       fuzz/fuzz_document.cpp -o fuzz_document -pthread
+//   AFL_USE_ASAN=1 afl-clang-fast++ -std=c++20 -g -O1 -fsanitize=fuzzer -Iinclude
+//       fuzz/fuzz_document.cpp -o fuzz_document_afl -pthread
+//
+// Any other compiler can build a harness together with fuzz/replay.cpp to run
+// saved inputs, e.g. a crash found elsewhere:
+//
+//   c++ -std=c++20 -g -fsanitize=address,undefined -Iinclude
+//       fuzz/fuzz_document.cpp fuzz/replay.cpp -o replay_document -pthread
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+#include <papr/papr.hpp>
+
+// Fails the run when an invariant does not hold. Unlike assert it is never
+// compiled out.
+#define PAPR_FUZZ_CHECK(cond)                                                   \
+  do {                                                                          \
+    if (!(cond)) {                                                              \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      std::abort();                                                             \
+    }                                                                           \
+  } while (0)
+
+namespace papr::fuzz {
+
+// A small limit, so deep inputs hit it quickly.
+inline constexpr std::uint32_t max_depth = 64;
+
+inline std::string_view as_text(const std::uint8_t* data, std::size_t size) noexcept {
+  return {reinterpret_cast<const char*>(data), size};
+}
+
+// Two documents are the same when their tapes and token values match, wherever
+// the token text lives.
+inline bool same_tree(const document& a, const document& b) {
+  if (a.size() != b.size()) return false;
+  std::string sa, sb;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (a[i].depth != b[i].depth || a[i].next != b[i].next) return false;
+    if (a.value(i, sa) != b.value(i, sb)) return false;
+  }
+  return true;
+}
+
+} // namespace papr::fuzz
@@ -0,0 +1,47 @@
+// papr - fuzz_binary.cpp
+// A .paprb image from an untrusted source either fails verify_binary or reads
+// like any document: no read leaves the image and every lookup finishes. See
+// fuzz.hpp to build it.
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fuzz.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+  // load_binary wants the image 8-byte aligned.
+  std::vector<std::uint64_t> storage(size / sizeof(std::uint64_t) + 1);
+  if (size > 0) std::memcpy(storage.data(), data, size);
+  const std::string_view image{reinterpret_cast<const char*>(storage.data()), size};
+  papr::document doc;
+  if (!papr::load_binary(image, doc).ok() || !papr::verify_binary(doc).ok()) return 0;
+
+  // Every node inside a subtree is deeper than its root, and `next` is the
+  // first node that is not.
+  for (std::size_t i = 0; i < doc.size() && i < 256; ++i) {
+    const auto next = static_cast<std::size_t>(doc[i].next);
+    for (std::size_t j = i + 1; j < next && j < i + 256; ++j)
+      PAPR_FUZZ_CHECK(doc[j].depth > doc[i].depth);
+    PAPR_FUZZ_CHECK(next == doc.size() || doc[next].depth <= doc[i].depth);
+  }
+
+  std::vector<std::size_t> path; // latest node at each depth
+  std::string scratch;
+  for (std::size_t i = 0; i < doc.size() && i < 256; ++i) {
+    const std::uint32_t d = doc[i].depth;
+    path.resize(d + 1);
+    path[d] = i;
+    const std::size_t parent = d == 0 ? papr::element::root_index : path[d - 1];
+    const std::string key{doc.value(i, scratch)};
+    const std::size_t found = doc.find_child(parent, key);
+    PAPR_FUZZ_CHECK(found == papr::element::root_index ||
+                    (doc.is_child(found, parent) && doc.key_equals(found, key)));
+  }
+  // A key the image may not hold has to end its probe too.
+  const std::string_view other = "\"not a key\"";
+  const std::size_t missing = doc.find_child(papr::element::root_index, other);
+  PAPR_FUZZ_CHECK(missing == papr::element::root_index || doc.key_equals(missing, other));
+  return 0;
+}
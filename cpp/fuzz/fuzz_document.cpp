@@ -0,0 +1,203 @@
+// papr - fuzz_document.cpp
+// Every way of building a document must agree with papr::parse: the parallel
+// builder, the streaming parser, projected, lazy and compact parsing,
+// incremental re-parsing, patches from papr::diff and .paprb images; validate
+// must report the same errors, and subtree hashes must not depend on when
+// they are made. Lookups through the key index must agree with sibling scans.
+// See fuzz.hpp to build it.
+
+#include <algorithm>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fuzz.hpp"
+
+namespace {
+
+struct counting_handler {
+  std::size_t tokens = 0;
+  void on_key(std::string_view) { ++tokens; }
+  void on_value(std::string_view) { ++tokens; }
+  void on_depth_up() {}
+  void on_sibling() {}
+  void on_depth_down() {}
+};
+
+// Walks both in step; the lazy document has to find the same tokens.
+bool same_lazy_tree(papr::element e, papr::lazy_element l) {
+  std::string a, b;
+  if (!e.is_root() && e.value(a) != l.value(b)) return false;
+  papr::element ec = e.first_child();
+  papr::lazy_element lc = l.first_child();
+  for (; ec && lc; ec = ec.next_sibling(), lc = lc.next_sibling())
+    if (!same_lazy_tree(ec, lc)) return false;
+  return !ec && !lc;
+}
+
+// A patch between two documents that have nothing to do with each other, such
+// as the two halves of an input, rebuilds the second one.
+void check_patch(std::string_view from_text, std::string_view to_text) {
+  papr::document from, to;
+  if (!papr::parse(from_text, from, papr::backend::automatic, papr::fuzz::max_depth).ok() ||
+      !papr::parse(to_text, to, papr::backend::automatic, papr::fuzz::max_depth).ok())
+    return;
+  const papr::patch change = papr::diff(from, to);
+  // Trusting the subtree hashes must give the same patch as verifying them.
+  const papr::patch verified = papr::diff(from, to, {.verify = true});
+  PAPR_FUZZ_CHECK(change.text() == verified.text() &&
+                  change.edits().size() == verified.edits().size());
+  std::string patched;
+  PAPR_FUZZ_CHECK(
+      papr::apply(change, from, patched, papr::backend::automatic, papr::fuzz::max_depth).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(from, to));
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+  const std::string_view input = papr::fuzz::as_text(data, size);
+  check_patch(input.substr(0, size / 2), input.substr(size / 2));
+  papr::document doc;
+  const papr::status st =
+      papr::parse(input, doc, papr::backend::automatic, papr::fuzz::max_depth);
+
+  papr::document parallel;
+  papr::parallel_options options;
+  options.threads = 3;
+  options.min_chunk_size = 1;
+  options.max_depth = papr::fuzz::max_depth;
+  const papr::status pst = papr::parse_parallel(input, parallel, options);
+  PAPR_FUZZ_CHECK(pst.code == st.code && pst.offset == st.offset);
+
+  counting_handler handler;
+  papr::stream_parser<counting_handler> stream{handler};
+  stream.set_max_depth(papr::fuzz::max_depth);
+  papr::status sst = stream.feed(input.substr(0, size / 2));
+  if (sst.ok()) sst = stream.feed(input.substr(size / 2));
+  if (sst.ok()) sst = stream.finish();
+  PAPR_FUZZ_CHECK(sst.ok() == st.ok());
+
+  // Projecting everything is parsing; projecting one key succeeds wherever
+  // parsing does.
+  papr::projection everything;
+  everything.add(std::span<const std::string_view>{});
+  papr::document projected;
+  const papr::status prst = papr::parse_projected(input, projected, everything,
+                                                  papr::backend::automatic, papr::fuzz::max_depth);
+  PAPR_FUZZ_CHECK(prst.code == st.code && prst.offset == st.offset);
+  const papr::validation vst =
+      papr::validate(input, papr::backend::automatic, papr::fuzz::max_depth);
+  PAPR_FUZZ_CHECK(vst.st.code == st.code && vst.st.offset == st.offset);
+  papr::compact_document compact;
+  const papr::status cst =
+      papr::parse(input, compact, papr::backend::automatic, papr::fuzz::max_depth);
+  PAPR_FUZZ_CHECK(cst.code == st.code && cst.offset == st.offset);
+  if (!st.ok()) {
+    PAPR_FUZZ_CHECK(doc.empty() && st.offset <= size);
+    return 0;
+  }
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, parallel));
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, projected));
+  papr::lazy_document lazy;
+  PAPR_FUZZ_CHECK(lazy.open(input, papr::backend::automatic, papr::fuzz::max_depth).ok());
+  PAPR_FUZZ_CHECK(same_lazy_tree(doc.root(), lazy.root()) && lazy.error().ok());
+  if (!doc.empty()) {
+    std::string first{doc.value(0)};
+    papr::projection one;
+    one.add({first});
+    PAPR_FUZZ_CHECK(papr::parse_projected(input, projected, one, papr::backend::automatic,
+                                          papr::fuzz::max_depth)
+                        .ok());
+    PAPR_FUZZ_CHECK(!projected.empty() && projected[0].offset == doc[0].offset);
+  }
+  PAPR_FUZZ_CHECK(handler.tokens == doc.size());
+  // The compact tape holds the same nodes in narrower fields.
+  PAPR_FUZZ_CHECK(compact.size() == doc.size());
+  for (std::size_t i = 0; i < doc.size(); ++i) {
+    const papr::node& n = doc[i];
+    const papr::compact_node& c = compact[i];
+    PAPR_FUZZ_CHECK(n.depth <= papr::fuzz::max_depth);
+    PAPR_FUZZ_CHECK(c.offset == n.offset && c.length == n.length && c.next == n.next &&
+                    c.depth == n.depth && c.flags == n.flags);
+  }
+
+  // Every key found by scanning is found through the index, and the binary
+  // image answers the same.
+  papr::document indexed;
+  papr::parse(input, indexed, papr::backend::automatic, papr::fuzz::max_depth);
+  indexed.build_index();
+  // Hashing while parsing matches hashing afterwards.
+  papr::parser hashing;
+  hashing.set_max_depth(papr::fuzz::max_depth);
+  hashing.set_hash_subtrees(true);
+  PAPR_FUZZ_CHECK(hashing.parse(input).ok());
+  indexed.hash_subtrees();
+  PAPR_FUZZ_CHECK(std::ranges::equal(hashing.doc().subtree_hashes(), indexed.subtree_hashes()));
+  const std::string image = papr::to_binary(indexed); // heap storage, so 8-byte aligned
+  papr::document loaded;
+  PAPR_FUZZ_CHECK(papr::load_binary(image, loaded).ok());
+  PAPR_FUZZ_CHECK(papr::verify_binary(loaded).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, loaded));
+  std::vector<std::size_t> path; // latest node at each depth
+  std::string scratch;
+  for (std::size_t i = 0; i < doc.size() && i < 256; ++i) {
+    const std::uint32_t d = doc[i].depth;
+    path.resize(d + 1);
+    path[d] = i;
+    const std::size_t parent = d == 0 ? papr::element::root_index : path[d - 1];
+    const std::string key{doc.value(i, scratch)};
+    const std::size_t found = doc.find_child(parent, key);
+    PAPR_FUZZ_CHECK(found != papr::element::root_index && found <= i);
+    PAPR_FUZZ_CHECK(indexed.find_child(parent, key) == found);
+    PAPR_FUZZ_CHECK(loaded.find_child(parent, key) == found);
+  }
+
+  // Deleting a byte and re-parsing incrementally matches a full parse, and
+  // the key index and symbols it updates answer as a fresh document does,
+  // in memory and as an image.
+  indexed.intern();
+  if (size > 0) {
+    const std::size_t at = data[0] % size;
+    std::string edited(input);
+    edited.erase(at, 1);
+    papr::document full;
+    const papr::status fst =
+        papr::parse(edited, full, papr::backend::automatic, papr::fuzz::max_depth);
+    const papr::status rst = papr::reparse(indexed, edited, {at, 1, 0}, papr::backend::automatic,
+                                           papr::fuzz::max_depth);
+    PAPR_FUZZ_CHECK(rst.code == fst.code && rst.offset == fst.offset);
+    if (rst.ok()) {
+      PAPR_FUZZ_CHECK(papr::fuzz::same_tree(full, indexed));
+      full.hash_subtrees();
+      PAPR_FUZZ_CHECK(std::ranges::equal(full.subtree_hashes(), indexed.subtree_hashes()));
+      const std::string reimage = papr::to_binary(indexed);
+      PAPR_FUZZ_CHECK(papr::load_binary(reimage, loaded).ok());
+      path.clear();
+      for (std::size_t i = 0; i < full.size() && i < 256; ++i) {
+        const std::uint32_t d = full[i].depth;
+        path.resize(d + 1);
+        path[d] = i;
+        const std::size_t parent = d == 0 ? papr::element::root_index : path[d - 1];
+        const std::string key{full.value(i, scratch)};
+        const std::size_t found = full.find_child(parent, key);
+        PAPR_FUZZ_CHECK(indexed.find_child(parent, key) == found);
+        PAPR_FUZZ_CHECK(loaded.find_child(parent, key) == found);
+        PAPR_FUZZ_CHECK(indexed.symbols().text(indexed.symbol(i)) == key);
+      }
+    }
+
+    // A patch from the original to the edited text rebuilds the edited tree.
+    if (fst.ok()) {
+      const papr::patch change = papr::diff(doc, full);
+      std::string patched;
+      PAPR_FUZZ_CHECK(papr::apply(change, doc, patched, papr::backend::automatic,
+                                  papr::fuzz::max_depth)
+                          .ok());
+      PAPR_FUZZ_CHECK(papr::fuzz::same_tree(full, doc));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+// papr - fuzz_serializer.cpp
+// Whatever parses must survive minify, pretty and the encoder unchanged, and
+// minifying a stream must produce text that parses to the same document. See
+// fuzz.hpp to build it.
+
+#include <span>
+#include <string>
+
+#include "fuzz.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+  const std::string_view input = papr::fuzz::as_text(data, size);
+  papr::document doc;
+  if (!papr::parse(input, doc).ok()) return 0;
+
+  const std::string small = papr::minify(doc);
+  PAPR_FUZZ_CHECK(small.size() <= size);
+  papr::document again;
+  PAPR_FUZZ_CHECK(papr::parse(small, again).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, again));
+  PAPR_FUZZ_CHECK(papr::minify(again) == small);
+
+  const std::string laid_out = papr::pretty(doc);
+  PAPR_FUZZ_CHECK(laid_out.size() == papr::pretty_size(doc));
+  PAPR_FUZZ_CHECK(papr::parse(laid_out, again).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, again));
+
+  // Encode the tape again through chunks small enough to split tokens.
+  std::string encoded;
+  {
+    papr::chunked_sink sink{[&](std::string_view chunk) -> papr::status {
+      encoded.append(chunk);
+      return {};
+    }, 7};
+    papr::encoder enc{sink};
+    const std::span<const papr::node> nodes = doc.nodes();
+    std::string scratch;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      const std::string_view v = doc.value(i, scratch);
+      const std::uint32_t after = i + 1 < nodes.size() ? nodes[i + 1].depth : 0;
+      if (after > nodes[i].depth) {
+        enc.begin_key(v);
+        continue;
+      }
+      enc.value(v);
+      for (std::uint32_t d = nodes[i].depth; d > after; --d) enc.end();
+      enc.next();
+    }
+    PAPR_FUZZ_CHECK(enc.finish().ok());
+    PAPR_FUZZ_CHECK(sink.flush().ok());
+  }
+  PAPR_FUZZ_CHECK(papr::parse(encoded, again).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, again));
+
+  papr::output_buffer streamed;
+  PAPR_FUZZ_CHECK(papr::minify(input, streamed).ok());
+  PAPR_FUZZ_CHECK(papr::parse(streamed.view(), again).ok());
+  PAPR_FUZZ_CHECK(papr::fuzz::same_tree(doc, again));
+  return 0;
+}
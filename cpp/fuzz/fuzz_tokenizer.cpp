@@ -0,0 +1,39 @@
+// papr - fuzz_tokenizer.cpp
+// Every scanner backend must produce the same token stream and the same
+// error, and every token must view its input. See fuzz.hpp to build it.
+
+#include "fuzz.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+  const std::string_view input = papr::fuzz::as_text(data, size);
+  papr::tokenizer reference{input, papr::backend::scalar};
+  for (const papr::backend b : {papr::backend::sse2, papr::backend::avx2, papr::backend::neon}) {
+    if (!papr::is_supported(b)) continue;
+    papr::tokenizer scalar{input, papr::backend::scalar};
+    papr::tokenizer other{input, b};
+    for (;;) {
+      const papr::token x = scalar.next();
+      const papr::token y = other.next();
+      PAPR_FUZZ_CHECK(x.kind == y.kind && x.flags == y.flags);
+      PAPR_FUZZ_CHECK(x.text.data() == y.text.data() && x.text.size() == y.text.size());
+      if (x.kind == papr::token_kind::end) break;
+      if (x.kind == papr::token_kind::error) {
+        PAPR_FUZZ_CHECK(scalar.error() == other.error());
+        PAPR_FUZZ_CHECK(scalar.error_offset() == other.error_offset());
+        PAPR_FUZZ_CHECK(scalar.error_offset() <= size);
+        break;
+      }
+    }
+  }
+
+  std::string scratch;
+  for (papr::token t = reference.next(); t.kind != papr::token_kind::end; t = reference.next()) {
+    if (t.kind == papr::token_kind::error) {
+      PAPR_FUZZ_CHECK(reference.next().kind == papr::token_kind::error);
+      break;
+    }
+    PAPR_FUZZ_CHECK(reference.offset_of(t) + t.text.size() <= size);
+    if (t.is_text()) PAPR_FUZZ_CHECK(papr::decode(t, scratch).size() <= t.text.size());
+  }
+  return 0;
+}
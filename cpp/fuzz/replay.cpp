@@ -0,0 +1,39 @@
+// papr - replay.cpp
+// Runs a harness over saved inputs without libFuzzer: each argument is a file
+// to feed it, or no argument reads one input from stdin.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size);
+
+namespace {
+
+bool run(std::FILE* f) {
+  std::vector<std::uint8_t> bytes;
+  std::uint8_t buffer[65536];
+  for (std::size_t n; (n = std::fread(buffer, 1, sizeof buffer, f)) > 0;)
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  if (std::ferror(f)) return false;
+  LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc == 1) return run(stdin) ? 0 : 1;
+  for (int i = 1; i < argc; ++i) {
+    std::FILE* f = std::fopen(argv[i], "rb");
+    if (f == nullptr || !run(f)) {
+      std::fprintf(stderr, "could not read %s\n", argv[i]);
+      return 1;
+    }
+    std::fclose(f);
+  }
+  return 0;
+}
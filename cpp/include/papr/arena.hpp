@@ -0,0 +1,114 @@
+// papr - arena.hpp
+// A monotonic memory resource that keeps its capacity across resets.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "stats.hpp"
+
+namespace papr {
+
+// Bump allocator for short-lived documents. Deallocation is a no-op; memory
+// comes back all at once through reset() or release(). Unlike
+// std::pmr::monotonic_buffer_resource, reset() keeps the memory: if the last
+// round spilled into several blocks they are merged into one block of the
+// combined size, so a parse loop over similar inputs stops calling upstream
+// after the first iteration.
+class arena final : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t default_block_size = 64 * 1024;
+
+  explicit arena(std::size_t initial_size = default_block_size,
+                 std::pmr::memory_resource* upstream =
+                     std::pmr::new_delete_resource()) noexcept
+      : upstream_(upstream),
+        next_block_size_(initial_size ? initial_size : default_block_size) {}
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+  ~arena() override { release(); }
+
+  // Forgets every allocation but keeps (and if needed coalesces) the blocks.
+  void reset() {
+    if (head_ != nullptr && head_->prev != nullptr) {
+      const std::size_t total = capacity_;
+      release();
+      next_block_size_ = total;
+      add_block(0);
+    }
+    if (head_ != nullptr) {
+      cur_ = head_->data();
+      end_ = cur_ + head_->size;
+    }
+    used_ = 0;
+  }
+
+  // Returns every block to the upstream resource.
+  void release() noexcept {
+    while (head_ != nullptr) {
+      block* prev = head_->prev;
+      upstream_->deallocate(head_, sizeof(block) + head_->size,
+                            alignof(std::max_align_t));
+      head_ = prev;
+    }
+    cur_ = end_ = nullptr;
+    used_ = capacity_ = 0;
+  }
+
+  // Bytes handed out since the last reset, including alignment padding.
+  std::size_t used() const noexcept { return used_; }
+  // Bytes owned across all blocks.
+  std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+  struct alignas(std::max_align_t) block {
+    block* prev;
+    std::size_t size;
+    char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  void add_block(std::size_t min_size) {
+    std::size_t size = next_block_size_;
+    while (size < min_size) size *= 2;
+    void* mem = upstream_->allocate(sizeof(block) + size, alignof(std::max_align_t));
+    head_ = ::new (mem) block{head_, size};
+    cur_ = head_->data();
+    end_ = cur_ + size;
+    capacity_ += size;
+    next_block_size_ = size * 2;
+  }
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    PAPR_STAT_ADD(arena_bytes, bytes);
+    auto aligned = [&]() noexcept {
+      const auto p = reinterpret_cast<std::uintptr_t>(cur_);
+      return reinterpret_cast<char*>((p + alignment - 1) & ~(alignment - 1));
+    };
+    char* p = cur_ ? aligned() : nullptr;
+    if (p == nullptr || p > end_ || static_cast<std::size_t>(end_ - p) < bytes) {
+      add_block(bytes + alignment);
+      p = aligned();
+    }
+    used_ += static_cast<std::size_t>(p + bytes - cur_);
+    cur_ = p + bytes;
+    return p;
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) noexcept override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  std::pmr::memory_resource* upstream_;
+  block* head_ = nullptr;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+  std::size_t used_ = 0;
+  std::size_t capacity_ = 0;
+  std::size_t next_block_size_;
+};
+
+} // namespace papr
@@ -0,0 +1,258 @@
+// papr - batch.hpp
+// Parsing many small documents at once on a pool of worker threads.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "document.hpp"
+#include "error.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+struct batch_options {
+  // Threads parsing a batch, the calling one included; 0 means
+  // std::thread::hardware_concurrency().
+  unsigned threads = 0;
+  backend scan = backend::automatic;
+  // The deepest nesting accepted; see papr::parse.
+  std::uint32_t max_depth = default_max_depth;
+  bool index = false;  // build the key index of every document
+  bool intern = false; // intern every document
+  bool hashes = false; // hash the subtrees of every document
+  // The first block of each worker's arena.
+  std::size_t arena_size = arena::default_block_size;
+};
+
+// One input's outcome. A document that failed to parse is empty.
+struct batch_result {
+  status st;
+  document doc;
+};
+
+// Parses batches of independent documents in parallel. The pool's threads
+// live as long as the batch_parser, and each has its own arena that every
+// batch reuses, so after the first few batches parsing allocates nothing
+// from upstream.
+//
+// A batch is dealt out to the workers in equal contiguous runs. A worker that
+// finishes its run steals the back half of another's, so a few large inputs
+// do not leave the other threads idle.
+class batch_parser {
+public:
+  explicit batch_parser(const batch_options& options = {});
+  batch_parser(const batch_parser&) = delete;
+  batch_parser& operator=(const batch_parser&) = delete;
+  ~batch_parser();
+
+  // Parses every input. Result i belongs to inputs[i], whether or not the
+  // others parsed. The results, and the documents in them, are valid until
+  // the next batch or until the batch_parser is destroyed; each document
+  // views its input, which has to stay alive as long.
+  std::span<const batch_result> parse_batch(std::span<const std::string_view> inputs);
+
+  std::span<const batch_result> results() const noexcept { return results_; }
+  unsigned threads() const noexcept { return static_cast<unsigned>(workers_.size()); }
+
+private:
+  // A worker's share of the batch, as [begin, end) packed into one word so
+  // that its owner and thieves can both take from it with a single CAS.
+  struct alignas(64) worker {
+    explicit worker(std::size_t arena_size) : memory(arena_size) {}
+
+    std::atomic<std::uint64_t> range{0};
+    arena memory;
+    std::exception_ptr error;
+#if defined(PAPR_ENABLE_STATS)
+    parse_stats counted;
+#endif
+  };
+
+  static constexpr std::uint64_t pack(std::uint64_t begin, std::uint64_t end) noexcept {
+    return begin | end << 32;
+  }
+
+  bool take(worker& self, std::size_t& index) noexcept;
+  bool steal(std::size_t thief, std::size_t& index) noexcept;
+  void work(std::size_t id);
+  void parse_one(worker& self, std::size_t index);
+  void serve(std::size_t id);
+
+  batch_options options_;
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::vector<batch_result> results_;
+  std::span<const std::string_view> inputs_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::uint64_t generation_ = 0; // bumped for every batch the pool works on
+  std::size_t running_ = 0;      // pool threads still busy with the batch
+  bool stop_ = false;
+};
+
+inline batch_parser::batch_parser(const batch_options& options) : options_(options) {
+  const unsigned count = options.threads ? options.threads
+                                         : std::max(1u, std::thread::hardware_concurrency());
+  workers_.reserve(count);
+  for (unsigned i = 0; i < count; ++i)
+    workers_.push_back(std::make_unique<worker>(options.arena_size));
+  // Worker 0 is whichever thread calls parse_batch.
+  threads_.reserve(count - 1);
+  for (unsigned i = 1; i < count; ++i) threads_.emplace_back([this, i] { serve(i); });
+}
+
+inline batch_parser::~batch_parser() {
+  {
+    std::lock_guard lock{mutex_};
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& t : threads_) t.join();
+  results_.clear(); // before the arenas the documents live in
+}
+
+inline std::span<const batch_result> batch_parser::parse_batch(
+    std::span<const std::string_view> inputs) {
+  PAPR_TRACE_SCOPE("papr::parse_batch");
+  // The old documents go before the arenas they were allocated from are
+  // reset.
+  results_.clear();
+  results_.resize(inputs.size());
+  inputs_ = inputs;
+
+  const std::size_t count = workers_.size();
+  const bool pooled = count > 1 && inputs.size() > 1;
+  const std::size_t shares = pooled ? count : 1;
+  for (std::size_t w = 0; w < count; ++w) {
+    worker& self = *workers_[w];
+    self.memory.reset();
+    self.error = nullptr;
+#if defined(PAPR_ENABLE_STATS)
+    // A batch the pool sits out must not add the last one's counts again.
+    self.counted = {};
+#endif
+    const std::size_t begin = w < shares ? inputs.size() * w / shares : 0;
+    const std::size_t end = w < shares ? inputs.size() * (w + 1) / shares : 0;
+    self.range.store(pack(begin, end), std::memory_order_relaxed);
+  }
+
+  if (pooled) {
+    {
+      std::lock_guard lock{mutex_};
+      ++generation_;
+      running_ = threads_.size();
+    }
+    wake_.notify_all();
+  }
+  work(0);
+  if (pooled) {
+    std::unique_lock lock{mutex_};
+    done_.wait(lock, [&] { return running_ == 0; });
+  }
+
+  for (const std::unique_ptr<worker>& w : workers_) {
+#if defined(PAPR_ENABLE_STATS)
+    if (w.get() != workers_[0].get()) detail::thread_stats() += w->counted;
+#endif
+    if (w->error) std::rethrow_exception(w->error);
+  }
+  return results_;
+}
+
+// Takes the next input from the front of the worker's own run.
+inline bool batch_parser::take(worker& self, std::size_t& index) noexcept {
+  std::uint64_t r = self.range.load(std::memory_order_acquire);
+  for (;;) {
+    const std::uint64_t begin = r & 0xffffffff, end = r >> 32;
+    if (begin >= end) return false;
+    if (self.range.compare_exchange_weak(r, pack(begin + 1, end), std::memory_order_acq_rel)) {
+      index = static_cast<std::size_t>(begin);
+      return true;
+    }
+  }
+}
+
+// Moves the back half of another worker's run to `thief`, and takes the
+// first input of it.
+inline bool batch_parser::steal(std::size_t thief, std::size_t& index) noexcept {
+  const std::size_t count = workers_.size();
+  for (std::size_t k = 1; k < count; ++k) {
+    worker& victim = *workers_[(thief + k) % count];
+    std::uint64_t r = victim.range.load(std::memory_order_acquire);
+    for (;;) {
+      const std::uint64_t begin = r & 0xffffffff, end = r >> 32;
+      if (begin >= end) break;
+      const std::uint64_t split = end - (end - begin + 1) / 2;
+      if (victim.range.compare_exchange_weak(r, pack(begin, split), std::memory_order_acq_rel)) {
+        workers_[thief]->range.store(pack(split + 1, end), std::memory_order_release);
+        index = static_cast<std::size_t>(split);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+inline void batch_parser::work(std::size_t id) {
+  worker& self = *workers_[id];
+  try {
+    for (std::size_t i = 0; take(self, i) || steal(id, i);) parse_one(self, i);
+  } catch (...) {
+    // What is left of the run gets stolen by the others.
+    self.error = std::current_exception();
+  }
+}
+
+inline void batch_parser::parse_one(worker& self, std::size_t index) {
+  batch_result& out = results_[index];
+  out.doc = document{&self.memory};
+  out.st = detail::build(inputs_[index], out.doc, options_.scan, options_.max_depth, false,
+                         options_.hashes);
+  if (!out.st.ok()) return;
+  if (options_.index) out.doc.build_index();
+  if (options_.intern) out.doc.intern();
+}
+
+inline void batch_parser::serve(std::size_t id) {
+  std::uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock lock{mutex_};
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+    }
+#if defined(PAPR_ENABLE_STATS)
+    detail::thread_stats() = {};
+#endif
+    work(id);
+#if defined(PAPR_ENABLE_STATS)
+    workers_[id]->counted = detail::thread_stats();
+#endif
+    bool last;
+    {
+      std::lock_guard lock{mutex_};
+      last = --running_ == 0;
+    }
+    if (last) done_.notify_one();
+  }
+}
+
+} // namespace papr
@@ -0,0 +1,231 @@
+// papr - binary.hpp
+// The .paprb format: a document's tape, string table and key index, loadable
+// from memory without parsing.
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "document.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "parser.hpp"
+#include "writer.hpp"
+
+namespace papr {
+
+// A .paprb image is this header followed by node_count nodes, slot_count key
+// index slots and text_size bytes of string table, all little-endian with
+// fixed-width fields. Nodes are stored exactly as in memory, with offsets into
+// the string table instead of the source, so a loaded image is used in place.
+struct binary_header {
+  static constexpr std::uint32_t current_version = 1;
+
+  char magic[4] = {'P', 'A', 'P', 'B'};
+  std::uint32_t version = current_version;
+  std::uint64_t node_count = 0;
+  std::uint64_t slot_count = 0; // zero when the image has no key index
+  std::uint64_t text_size = 0;
+};
+
+static_assert(sizeof(binary_header) == 32 && std::is_trivially_copyable_v<binary_header>);
+static_assert(sizeof(node) == 32 && std::is_trivially_copyable_v<node>);
+static_assert(sizeof(index_slot) == 16 && std::is_trivially_copyable_v<index_slot>);
+
+namespace detail {
+
+template <class T>
+std::string_view bytes_of(const T& value) noexcept {
+  return {reinterpret_cast<const char*>(&value), sizeof(T)};
+}
+
+template <class T>
+std::string_view bytes_of(std::span<const T> values) noexcept {
+  return {reinterpret_cast<const char*>(values.data()), values.size_bytes()};
+}
+
+} // namespace detail
+
+// Writes `doc` as a .paprb image. Token text goes into the string table raw,
+// escapes included, and each distinct text is stored once, so the keys that
+// repeat in every record of a list cost their bytes only once. The key index
+// is written when the document has one.
+template <sink Sink>
+void write_binary(const document& doc, Sink& out) {
+  std::pmr::unordered_map<std::string_view, std::uint64_t> strings(doc.resource());
+  std::pmr::vector<std::uint64_t> offsets(doc.resource());
+  std::pmr::vector<std::string_view> table(doc.resource());
+  offsets.reserve(doc.size());
+  binary_header header;
+  for (std::size_t i = 0; i < doc.size(); ++i) {
+    const std::string_view text = doc.raw(i);
+    const auto [it, inserted] = strings.try_emplace(text, header.text_size);
+    if (inserted) {
+      table.push_back(text);
+      header.text_size += text.size();
+    }
+    offsets.push_back(it->second);
+  }
+  std::span<const index_slot> slots = detail::document_access::table(doc);
+  // An image files keys under tape indices, as build_index does. A document
+  // that reparse renumbered files them under key ids (document::key_id), so
+  // its entries are filed again, each with its hash rekeyed from its parent's
+  // key id to its parent's index without reading the value.
+  std::pmr::vector<index_slot> refiled(doc.resource());
+  if (detail::document_access::has_key_ids(doc)) {
+    std::pmr::vector<std::size_t> parents(doc.size(), element::root_index, doc.resource());
+    std::pmr::vector<std::size_t> path(doc.resource()); // latest node at each depth
+    for (std::size_t i = 0; i < doc.size(); ++i) {
+      const std::uint32_t d = doc[i].depth;
+      if (path.size() <= d) path.resize(d + 1);
+      path[d] = i;
+      if (d > 0) parents[i] = path[d - 1];
+    }
+    refiled.assign(slots.size(), index_slot{});
+    const std::size_t mask = slots.size() - 1;
+    for (const index_slot& s : slots) {
+      if (s.node == index_slot::empty) continue;
+      const std::size_t parent = parents[static_cast<std::size_t>(s.node)];
+      const std::uint64_t h =
+          rekey_hash(s.hash, detail::document_access::key_id(doc, parent), parent);
+      std::size_t slot = h & mask;
+      while (refiled[slot].node != index_slot::empty) slot = (slot + 1) & mask;
+      refiled[slot] = {h, s.node};
+    }
+    slots = refiled;
+  }
+  header.node_count = doc.size();
+  header.slot_count = slots.size();
+
+  out.write(detail::bytes_of(header));
+  for (std::size_t i = 0; i < doc.size(); ++i) {
+    node n = doc[i];
+    n.offset = offsets[i];
+    out.write(detail::bytes_of(n));
+  }
+  out.write(detail::bytes_of(slots));
+  for (const std::string_view text : table) out.write(text);
+}
+
+inline std::string to_binary(const document& doc) {
+  output_buffer out;
+  out.reserve(sizeof(binary_header) + doc.size() * sizeof(node) + doc.source().size());
+  write_binary(doc, out);
+  return out.release();
+}
+
+// Points `doc` at the .paprb image in `image` without copying or parsing
+// anything; the document views the image, which has to outlive it and be
+// 8-byte aligned, as a mapping or a heap buffer is. Only the header and the
+// sizes are checked, so images from an untrusted source should go through
+// verify_binary first.
+inline status load_binary(std::string_view image, document& doc) {
+  doc.clear();
+  binary_header header;
+  if constexpr (std::endian::native != std::endian::little)
+    return {error_code::invalid_binary, 0};
+  if (image.size() < sizeof header ||
+      reinterpret_cast<std::uintptr_t>(image.data()) % alignof(node) != 0)
+    return {error_code::invalid_binary, 0};
+  std::memcpy(&header, image.data(), sizeof header);
+  if (std::memcmp(header.magic, binary_header{}.magic, sizeof header.magic) != 0 ||
+      header.version != binary_header::current_version)
+    return {error_code::invalid_binary, 0};
+  const std::size_t room = image.size() - sizeof header;
+  if (header.node_count > room / sizeof(node) ||
+      header.slot_count > (room - header.node_count * sizeof(node)) / sizeof(index_slot) ||
+      header.text_size != room - header.node_count * sizeof(node) -
+                              header.slot_count * sizeof(index_slot) ||
+      (header.slot_count & (header.slot_count - 1)) != 0)
+    return {error_code::invalid_binary, sizeof header};
+
+  const char* p = image.data() + sizeof header;
+  const auto* nodes = reinterpret_cast<const node*>(p);
+  p += header.node_count * sizeof(node);
+  const auto* slots = reinterpret_cast<const index_slot*>(p);
+  p += header.slot_count * sizeof(index_slot);
+  detail::document_access::adopt(
+      doc, {p, static_cast<std::size_t>(header.text_size)},
+      {nodes, static_cast<std::size_t>(header.node_count)},
+      {slots, static_cast<std::size_t>(header.slot_count)});
+  return {};
+}
+
+// Checks every node of a loaded image against the invariants the tape has
+// after a parse, its nesting included, and the key index for room to end
+// every probe, so that no lookup on it can read out of bounds or loop
+// forever. The offset of a failure is that of the offending node in the
+// image.
+inline status verify_binary(const document& doc) noexcept {
+  const std::span<const node> nodes = doc.nodes();
+  const std::size_t text = doc.source().size();
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    const node& n = nodes[i];
+    const bool in_tape = n.next > i && n.next <= nodes.size() &&
+                         (i == 0 ? n.depth == 0 : n.depth <= nodes[i - 1].depth + 1) &&
+                         (n.next == nodes.size() || nodes[n.next].depth <= n.depth) &&
+                         (i + 1 == n.next || nodes[i + 1].depth > n.depth);
+    if (!in_tape || n.offset > text || n.length > text - n.offset)
+      return {error_code::invalid_binary, sizeof(binary_header) + i * sizeof(node)};
+  }
+  // Hopping from sibling to sibling through the children of a subtree must
+  // meet only nodes one level deeper and land exactly on its end. By
+  // induction every node inside a subtree is then deeper than its root, and
+  // `next` is the first node that is not. Each node is hopped over once, as a
+  // child of its parent or at the top level.
+  const auto children_fit = [&](std::size_t begin, std::size_t end, std::uint32_t depth) {
+    std::size_t c = begin;
+    for (; c < end; c = static_cast<std::size_t>(nodes[c].next))
+      if (nodes[c].depth != depth) return false;
+    return c == end;
+  };
+  if (!children_fit(0, nodes.size(), 0)) return {error_code::invalid_binary, sizeof(binary_header)};
+  for (std::size_t i = 0; i < nodes.size(); ++i)
+    if (!children_fit(i + 1, static_cast<std::size_t>(nodes[i].next), nodes[i].depth + 1))
+      return {error_code::invalid_binary, sizeof(binary_header) + i * sizeof(node)};
+  // The key index is probed until an empty slot turns up, so a table with
+  // none would make lookups spin. build_index sizes it to at least twice the
+  // node count and fills at most one slot per node.
+  const std::span<const index_slot> table = detail::document_access::table(doc);
+  if (!table.empty() && table.size() < 2 * nodes.size()) return {error_code::invalid_binary, 0};
+  std::size_t used = 0;
+  for (const index_slot& s : table) {
+    if (s.node == index_slot::empty) continue;
+    if (s.node >= nodes.size() || ++used > nodes.size()) return {error_code::invalid_binary, 0};
+  }
+  return {};
+}
+
+// A .paprb file mapped and loaded in place: opening one costs a mapping and a
+// header check, however large the document is.
+class binary_document {
+public:
+  explicit binary_document(std::pmr::memory_resource* resource =
+                               std::pmr::get_default_resource()) noexcept
+      : doc_(resource) {}
+
+  status open(const char* path) {
+    doc_.clear();
+    if (status st = file_.open(path); !st.ok()) return st;
+    return load_binary(file_.data(), doc_);
+  }
+
+  const document& doc() const noexcept { return doc_; }
+  const mapped_file& file() const noexcept { return file_; }
+
+private:
+  mapped_file file_;
+  document doc_;
+};
+
+} // namespace papr
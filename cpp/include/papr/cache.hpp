@@ -0,0 +1,380 @@
+// papr - cache.hpp
+// A process-wide cache of parsed files, shared by everyone who reads them.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "document.hpp"
+#include "epoch.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+namespace detail {
+
+// Reads the whole file at `path` into `out`. Unlike a mapping, the copy is
+// unaffected by later writes to the file or by its truncation. `String` is
+// std::string or std::pmr::string.
+template <class String>
+status read_file(const char* path, String& out) {
+  out.clear();
+  std::error_code ec;
+  if (const std::uintmax_t size = std::filesystem::file_size(path, ec); !ec)
+    out.reserve(static_cast<std::size_t>(size));
+  std::FILE* f = std::fopen(path, "rb");
+  if (f == nullptr) return {error_code::io_error, 0};
+  char buffer[65536];
+  for (std::size_t n; (n = std::fread(buffer, 1, sizeof buffer, f)) > 0;) out.append(buffer, n);
+  const bool failed = std::ferror(f) != 0;
+  std::fclose(f);
+  if (failed) return {error_code::io_error, 0};
+  return {};
+}
+
+} // namespace detail
+
+// A parsed file as the cache hands it out: a copy of the file's bytes, held
+// in the document's memory resource, and the document over it. It is fully
+// built before anyone sees it and never modified afterwards; every escaped
+// token is decoded up front, so any number of threads can read it at once
+// without locking, whatever happens to the file meanwhile.
+class cached_document {
+public:
+  const document& doc() const noexcept { return doc_; }
+  std::string_view text() const noexcept { return text_; }
+  // hash_bytes of the file's contents.
+  std::uint64_t content_hash() const noexcept { return hash_; }
+
+private:
+  friend class document_cache;
+
+  document doc_;
+  std::pmr::string text_{doc_.resource()};
+  std::uint64_t hash_ = 0;
+};
+
+struct cache_options {
+  backend scan = backend::automatic;
+  std::uint32_t max_depth = default_max_depth;
+  bool index = false;  // build the key index before sharing a document
+  bool intern = false; // intern it before sharing
+  bool hashes = false; // hash its subtrees while parsing
+};
+
+// Maps a path to the shared, immutable document parsed from it. An entry is
+// valid while the file's modification time, size and file id are unchanged;
+// a file that changed is parsed again on the next get(). A file written
+// within timestamp_granularity of being read could change again without its
+// stamp changing, so such an entry is only trusted until the next get(),
+// which reads the file again and keeps the document if the contents hash
+// the same. Files with the same contents, under different paths or before
+// and after a touch, share one document. Threads asking for a path that is
+// being parsed wait for that parse instead of starting their own.
+//
+// A get() that hits stats the file once and finds the path in an immutable
+// table, which it reaches the way a snapshot_handle reader does: it marks
+// itself active in a reader slot and loads the table pointer, taking no
+// lock. A miss copies the table under the cache's lock and publishes the
+// copy, in time linear in the number of cached paths; the old table is freed
+// once no reader can see it. The lock also covers the table of contents and
+// is never held while reading or parsing a file. Each file is
+// read into memory the document owns, so a handle keeps its document alive
+// and intact after the entry is replaced or erased, even if the file was
+// rewritten in place; old versions go away with their last reader.
+//
+// Even a hit makes a system call and bumps a shared reference count, so
+// callers that read in a hot loop should keep the handle rather than call
+// get() each time. When one document is hot-reloaded under many readers, a
+// snapshot_handle (snapshot.hpp) gives reads that make no system call.
+class document_cache {
+public:
+  using handle = std::shared_ptr<const cached_document>;
+
+  explicit document_cache(const cache_options& options = {}) : options_(options) {}
+  document_cache(const document_cache&) = delete;
+  document_cache& operator=(const document_cache&) = delete;
+  // No get() may still be running.
+  ~document_cache() {
+    delete entries_.load(std::memory_order_relaxed);
+    for (const retired& r : retired_) delete r.old;
+  }
+
+  // The cache most callers should use.
+  static document_cache& shared() {
+    static document_cache cache;
+    return cache;
+  }
+
+  // Sets `out` to the document parsed from `path`, reading and parsing the
+  // file only if it is not cached or changed since it was. Fails with
+  // io_error when the file cannot be read and with the parse error when it
+  // is not valid papr; failures are not cached.
+  status get(std::string_view path, handle& out);
+
+  // Forgets `path`, or every path. Handed-out handles stay valid.
+  void erase(std::string_view path);
+  void clear();
+
+  // The number of paths with an entry.
+  std::size_t size() const;
+
+  // How long after a write a file's stamp may still not show the next one:
+  // FAT keeps modification times to 2 s, and the others are finer.
+  static constexpr std::chrono::nanoseconds timestamp_granularity = std::chrono::seconds{2};
+
+private:
+  struct stamp {
+    std::int64_t mtime = 0; // nanoseconds since the Unix epoch
+    std::uint64_t size = 0;
+    // Tell a file renamed over the path apart; 0 where not available.
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    bool operator==(const stamp&) const = default;
+  };
+  struct result {
+    status st;
+    handle doc;
+  };
+  struct entry {
+    stamp when;
+    bool settled = false; // false if `when` may still hide a later write
+    std::shared_future<result> loaded;
+  };
+  struct path_hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view path) const noexcept {
+      return static_cast<std::size_t>(hash_bytes(path));
+    }
+  };
+  using table = std::unordered_map<std::string, entry, path_hash, std::equal_to<>>;
+  struct retired {
+    const table* old;
+    std::uint64_t epoch; // the epoch it was replaced in
+  };
+  // A hit holds its slot for one table lookup, so few are ever taken at once.
+  static constexpr std::size_t reader_slots = 64;
+
+  static bool stat_file(const char* path, stamp& out) noexcept;
+  static bool lookup(const table& entries, std::string_view path, const stamp& now,
+                     std::shared_future<result>& loaded);
+  void replace_locked(const table* next);
+  result load(const std::string& path);
+  void prune_contents(std::size_t paths);
+
+  cache_options options_;
+  // Path entries. A published table is never modified; a new one is stored
+  // only under mutex_, and the old one retired until no reader can see it.
+  std::atomic<const table*> entries_{new table};
+  detail::epoch_domain epochs_{reader_slots};
+  mutable std::mutex mutex_;
+  std::vector<retired> retired_;
+  // Documents by content hash, so that equal files are parsed and held once.
+  std::unordered_map<std::uint64_t, std::weak_ptr<const cached_document>> contents_;
+};
+
+// Fills `out` from one stat of `path`; false if it is not a regular file.
+inline bool document_cache::stat_file(const char* path, stamp& out) noexcept {
+#if defined(_WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data) ||
+      (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+    return false;
+  // FILETIME counts 100 ns ticks since 1601.
+  const std::int64_t ticks = static_cast<std::int64_t>(
+      (std::uint64_t{data.ftLastWriteTime.dwHighDateTime} << 32) |
+      data.ftLastWriteTime.dwLowDateTime);
+  out.mtime = (ticks - 116444736000000000) * 100;
+  out.size = (std::uint64_t{data.nFileSizeHigh} << 32) | data.nFileSizeLow;
+#else
+  struct stat st;
+  if (::stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+#if defined(__APPLE__)
+  const struct timespec& t = st.st_mtimespec;
+#else
+  const struct timespec& t = st.st_mtim;
+#endif
+  out.mtime = static_cast<std::int64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+  out.size = static_cast<std::uint64_t>(st.st_size);
+  out.device = static_cast<std::uint64_t>(st.st_dev);
+  out.inode = static_cast<std::uint64_t>(st.st_ino);
+#endif
+  return true;
+}
+
+// Sets `loaded` to the entry for `path` if it is still good for a get() that
+// saw `now`: the same stamp, and either settled or still loading, in which
+// case the get() waits for that load rather than start another.
+inline bool document_cache::lookup(const table& entries, std::string_view path,
+                                   const stamp& now, std::shared_future<result>& loaded) {
+  const auto it = entries.find(path);
+  if (it == entries.end() || !(it->second.when == now)) return false;
+  if (!it->second.settled &&
+      it->second.loaded.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+    return false;
+  loaded = it->second.loaded;
+  return true;
+}
+
+inline status document_cache::get(std::string_view path, handle& out) {
+  out.reset();
+  std::string key{path};
+  stamp now;
+  if (!stat_file(key.c_str(), now)) return {error_code::io_error, 0};
+
+  std::shared_future<result> loaded;
+  bool found;
+  {
+    const detail::epoch_domain::guard active = epochs_.enter();
+    found = lookup(*entries_.load(std::memory_order_seq_cst), key, now, loaded);
+  }
+  bool owner = false;
+  std::promise<result> promise;
+  if (!found) {
+    std::lock_guard lock{mutex_};
+    const table& entries = *entries_.load(std::memory_order_relaxed);
+    if (!lookup(entries, key, now, loaded)) {
+      const auto age = std::chrono::system_clock::now().time_since_epoch() -
+                       std::chrono::nanoseconds{now.mtime};
+      auto next = std::make_unique<table>(entries);
+      loaded = promise.get_future().share();
+      (*next)[key] = {now, age >= timestamp_granularity, loaded};
+      replace_locked(next.release());
+      owner = true;
+    }
+  }
+
+  if (owner) {
+    bool failed = true;
+    try {
+      result r = load(key);
+      failed = !r.st.ok();
+      promise.set_value(std::move(r));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+    if (failed) {
+      std::lock_guard lock{mutex_};
+      const table& entries = *entries_.load(std::memory_order_relaxed);
+      if (const auto it = entries.find(key); it != entries.end() && it->second.when == now) {
+        auto next = std::make_unique<table>(entries);
+        next->erase(key);
+        replace_locked(next.release());
+      }
+    }
+  }
+
+  const result& r = loaded.get();
+  if (!r.st.ok()) return r.st;
+  out = r.doc;
+  return {};
+}
+
+// Publishes `next` and frees every replaced table no reader can still see.
+inline void document_cache::replace_locked(const table* next) {
+  const table* old = entries_.exchange(next, std::memory_order_seq_cst);
+  retired_.push_back({old, epochs_.advance()});
+  const std::uint64_t oldest = epochs_.oldest();
+  std::size_t kept = 0;
+  for (const retired& r : retired_) {
+    if (r.epoch < oldest) {
+      delete r.old;
+    } else {
+      retired_[kept++] = r;
+    }
+  }
+  retired_.resize(kept);
+}
+
+inline document_cache::result document_cache::load(const std::string& path) {
+  auto file = std::make_shared<cached_document>();
+  if (status st = detail::read_file(path.c_str(), file->text_); !st.ok()) return {st, nullptr};
+  file->hash_ = hash_bytes(file->text());
+  {
+    std::lock_guard lock{mutex_};
+    const auto it = contents_.find(file->hash_);
+    if (it != contents_.end())
+      if (handle same = it->second.lock(); same && same->text() == file->text())
+        return {{}, std::move(same)};
+  }
+
+  document& doc = file->doc_;
+  if (status st = detail::build(file->text(), doc, options_.scan, options_.max_depth, false,
+                                options_.hashes);
+      !st.ok())
+    return {st, nullptr};
+  if (options_.index) doc.build_index();
+  if (options_.intern) doc.intern();
+  doc.materialize();
+
+  std::lock_guard lock{mutex_};
+  contents_[file->hash_] = file;
+  prune_contents(entries_.load(std::memory_order_relaxed)->size());
+  return {{}, std::move(file)};
+}
+
+// Drops content entries whose documents are gone, once they outnumber the
+// `paths` enough to matter.
+inline void document_cache::prune_contents(std::size_t paths) {
+  if (contents_.size() <= 2 * paths + 8) return;
+  for (auto it = contents_.begin(); it != contents_.end();)
+    it = it->second.expired() ? contents_.erase(it) : std::next(it);
+}
+
+inline void document_cache::erase(std::string_view path) {
+  std::lock_guard lock{mutex_};
+  const table& entries = *entries_.load(std::memory_order_relaxed);
+  const auto it = entries.find(path);
+  if (it == entries.end()) return;
+  auto next = std::make_unique<table>(entries);
+  next->erase(it->first);
+  const std::size_t paths = next->size();
+  replace_locked(next.release());
+  prune_contents(paths);
+}
+
+inline void document_cache::clear() {
+  std::lock_guard lock{mutex_};
+  replace_locked(new table);
+  contents_.clear();
+}
+
+inline std::size_t document_cache::size() const {
+  std::lock_guard lock{mutex_};
+  return entries_.load(std::memory_order_relaxed)->size();
+}
+
+} // namespace papr
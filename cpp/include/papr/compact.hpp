@@ -0,0 +1,37 @@
+// papr - compact.hpp
+// A tape of 16-byte nodes for inputs under 4 GiB.
+#pragma once
+
+#include <cstdint>
+
+#include "document.hpp"
+#include "parser.hpp"
+
+namespace papr {
+
+// The fields of a node in 32 bits each, with the depth and the flags sharing
+// one word: half the size, so a traversal reads twice as many per cache line.
+// The field names are those of node, so the same tape code reads both.
+struct compact_node {
+  static constexpr std::uint32_t flag_bits = 2;
+  static constexpr std::uint32_t max_depth = ~std::uint32_t{0} >> flag_bits;
+
+  std::uint32_t offset = 0;
+  std::uint32_t length = 0;
+  std::uint32_t next = 0;
+  std::uint32_t depth : 32 - flag_bits = 0;
+  std::uint32_t flags : flag_bits = 0; // node::flag bits
+};
+
+static_assert(sizeof(compact_node) == 16);
+static_assert((node::quoted | node::escaped) < (1u << compact_node::flag_bits));
+
+// A document whose tape holds compact_nodes: 16 bytes a token instead of 32.
+// It is built by papr::parse, which fails with input_too_large on sources of
+// 4 GiB or more, and reads like any document: the key index, symbols and
+// subtree hashes work the same. The functions that take a papr::document
+// (reparse, diff, the serializers, .paprb images) only take the wide tape.
+using compact_document = basic_document<compact_node>;
+using compact_element = basic_element<compact_node>;
+
+} // namespace papr
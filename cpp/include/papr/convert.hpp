@@ -0,0 +1,41 @@
+// papr - convert.hpp
+// Conversion of token values to numbers and booleans.
+#pragma once
+
+#include <charconv>
+#include <concepts>
+#include <string_view>
+#include <system_error>
+
+namespace papr {
+
+// The types a token value converts to: integers, floating point and bool.
+template <class T>
+concept scalar_value = std::integral<T> || std::floating_point<T>;
+
+// Converts the whole of `text` to `out`, leaving `out` untouched on failure.
+// Numbers go through std::from_chars, so the accepted syntax is the locale-
+// independent one it defines; a leading `+` is allowed as well. Booleans are
+// `true` and `false`.
+template <scalar_value T>
+bool convert(std::string_view text, T& out) noexcept {
+  if constexpr (std::same_as<T, bool>) {
+    if (text == "true") out = true;
+    else if (text == "false") out = false;
+    else return false;
+    return true;
+  } else {
+    const char* first = text.data();
+    const char* const last = first + text.size();
+    if (first != last && *first == '+') ++first;
+    // Rule out "+-1", which from_chars would otherwise read as negative.
+    if (first != text.data() && first != last && *first == '-') return false;
+    T value{};
+    const std::from_chars_result r = std::from_chars(first, last, value);
+    if (r.ec != std::errc{} || r.ptr != last || first == last) return false;
+    out = value;
+    return true;
+  }
+}
+
+} // namespace papr
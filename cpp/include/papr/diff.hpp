@@ -0,0 +1,341 @@
+// papr - diff.hpp
+// Structural differences between two documents, as patches to the source.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+#include "writer.hpp"
+
+namespace papr {
+
+struct diff_options {
+  // Compare subtrees whose hashes match token by token before skipping them,
+  // instead of trusting the 64-bit hash. Guards against a chance collision at
+  // the cost of a full pass over every unchanged subtree.
+  bool verify = false;
+};
+
+// What turns one document's source into text that parses to another one: a
+// list of replacements in the old source, in order and without overlap, and
+// the bytes they insert. Only the subtrees that differ are rewritten, so a
+// patch between two large versions that differ in a few keys is a few edits
+// and a few hundred bytes.
+class patch {
+public:
+  // Offsets and lengths in the source the patch was made from.
+  std::span<const edit> edits() const noexcept { return edits_; }
+  // The inserted bytes of every edit, one after another.
+  std::string_view text() const noexcept { return text_; }
+  // The nodes of the old document whose children differ, in tape order;
+  // element::root_index stands for the top level.
+  std::span<const std::size_t> parents() const noexcept { return parents_; }
+  // The size of the source it was made from.
+  std::size_t base_size() const noexcept { return base_size_; }
+  bool empty() const noexcept { return edits_.empty(); }
+
+private:
+  friend patch diff(const document& from, const document& to, const diff_options& options);
+
+  std::vector<edit> edits_;
+  std::string text_;
+  std::vector<std::size_t> parents_;
+  std::size_t base_size_ = 0;
+};
+
+namespace detail {
+
+// The subtree hashes of `doc`: its own when it has them, or else computed
+// into `buffer` as document::hash_subtrees would.
+inline std::span<const std::uint64_t> subtree_hashes(const document& doc,
+                                                     std::pmr::vector<std::uint64_t>& buffer) {
+  if (doc.has_subtree_hashes()) return doc.subtree_hashes();
+  buffer.assign(doc.size(), 0);
+  std::string scratch;
+  for (std::size_t i = doc.size(); i-- > 0;) {
+    const auto next = static_cast<std::size_t>(doc[i].next);
+    std::uint64_t h = subtree_seed(doc.value(i, scratch));
+    for (std::size_t c = i + 1; c < next; c = static_cast<std::size_t>(doc[c].next))
+      h = subtree_combine(h, buffer[c], c - i);
+    buffer[i] = subtree_finish(h, next - i);
+  }
+  return buffer;
+}
+
+// True when the subtree of `a` in `x` and that of `b` in `y` hold the same
+// values in the same shape. diff asks this of subtrees whose hashes match
+// when diff_options::verify is set.
+inline bool same_subtree(const document& x, std::size_t a, const document& y, std::size_t b) {
+  const std::size_t size = static_cast<std::size_t>(x[a].next) - a;
+  if (static_cast<std::size_t>(y[b].next) - b != size) return false;
+  std::string sx, sy;
+  for (std::size_t k = 0; k < size; ++k) {
+    const node& m = x[a + k];
+    const node& n = y[b + k];
+    if (m.depth - x[a].depth != n.depth - y[b].depth) return false;
+    if (!((m.flags | n.flags) & node::escaped) ? x.raw(a + k) != y.raw(b + k)
+                                              : x.value(a + k, sx) != y.value(b + k, sy))
+      return false;
+  }
+  return true;
+}
+
+// Where a node's token ends in the source, closing quote included.
+constexpr std::size_t token_end(const node& n) noexcept {
+  return static_cast<std::size_t>(n.offset + n.length) + ((n.flags & node::quoted) ? 1 : 0);
+}
+
+// One replacement while a patch is built: `lead`, `body`, and then, when
+// `closes` is set, the delimiters from `end_depth` down to `target`, the
+// depth of the token the replaced text stops at.
+struct pending_edit {
+  std::size_t begin = 0, end = 0;
+  std::string lead, body;
+  std::uint32_t depth = 0;     // of the siblings the body holds
+  std::uint32_t end_depth = 0; // where the body leaves the text
+  bool after_token = false;    // the body ends in a token, not a delimiter
+  bool append = false;         // starts after the last old child
+  bool closes = false;
+  std::uint32_t target = 0;
+};
+
+// The delimiters that go from depth `from` to `to`, either after a token or
+// after a delimiter that already left the text at `from`.
+inline void write_step(std::string& out, std::uint32_t from, bool after_token, std::uint32_t to) {
+  if (to > from) out += ':';
+  else if (to == from && after_token) out += ',';
+  else if (to < from) out.append(from - to, ';');
+}
+
+} // namespace detail
+
+// Compares two documents and returns the patch that takes the source of
+// `from` to text that parses to `to`. Both tapes are walked together, and a
+// pair of subtrees whose hashes match is skipped without looking inside it
+// (see diff_options::verify). A document parsed without subtree hashes
+// (parser::set_hash_subtrees) is hashed in full on every call. Children are
+// matched by value, trying the next old child first and then a key lookup
+// in `from`, which uses its key index or symbols when it has them, or else
+// a map of the children's keys made the first time a subtree needs one. Old
+// children passed over are dropped, and new ones without a match are
+// written out minified. A child that moved is dropped and written again
+// rather than moved.
+inline patch diff(const document& from, const document& to,
+                  const diff_options& options = {}) {
+  PAPR_TRACE_SCOPE("papr::diff");
+  using detail::token_begin;
+  using detail::token_end;
+  std::pmr::vector<std::uint64_t> old_buffer(from.resource()), new_buffer(to.resource());
+  const std::span<const std::uint64_t> old_hash = detail::subtree_hashes(from, old_buffer);
+  const std::span<const std::uint64_t> new_hash = detail::subtree_hashes(to, new_buffer);
+  const std::string_view source = from.source();
+
+  patch out;
+  out.base_size_ = source.size();
+  std::vector<detail::pending_edit> pending;
+  std::string scratch;
+
+  // A pair of matched nodes whose children are being compared. Old children
+  // from `o` and new ones from `run` have no match yet.
+  using key_map = std::pmr::unordered_map<std::string_view, std::size_t>;
+  struct frame {
+    std::size_t p, q;
+    std::size_t o, old_end;
+    std::size_t run, n, new_end;
+    std::uint32_t depth; // of the children
+    bool noted = false;  // p is in out.parents_
+    // The first old child with each key, for a `from` that has neither a key
+    // index nor symbols to look children up with. Filled on the first miss.
+    key_map keys;
+  };
+  std::vector<frame> stack;
+  const auto open = [&](std::size_t p, std::size_t q) {
+    const std::uint32_t depth = p == element::root_index ? 0 : from[p].depth + 1;
+    stack.push_back({p, q, from.children_begin(p), from.children_end(p), to.children_begin(q),
+                     to.children_begin(q), to.children_end(q), depth, false,
+                     key_map(from.resource())});
+  };
+  // Decoded escaped keys of the maps above.
+  std::pmr::monotonic_buffer_resource decoded_keys{from.resource()};
+  const bool scan_keys = !from.has_index() && !from.is_interned();
+  const auto find_old = [&](frame& f, std::string_view key) {
+    if (!scan_keys) return from.find_child(f.p, key);
+    if (f.keys.empty()) {
+      const std::size_t begin = from.children_begin(f.p);
+      f.keys.reserve(f.old_end - begin);
+      for (std::size_t c = begin; c < f.old_end; c = static_cast<std::size_t>(from[c].next))
+        f.keys.try_emplace(from.value(c, decoded_keys), c);
+    }
+    const auto it = f.keys.find(key);
+    return it == f.keys.end() ? element::root_index : it->second;
+  };
+
+  const auto add = [&](detail::pending_edit e) {
+    if (e.append && !pending.empty() && pending.back().end == e.end) {
+      // Children appended to a subtree whose last descendants were already
+      // rewritten: both replacements end where the next token starts (or at
+      // the end of the input), so the second carries on from the first and
+      // its lead, which assumed the old text, is not needed.
+      detail::pending_edit& last = pending.back();
+      detail::write_step(last.body, last.end_depth, last.after_token, e.depth);
+      last.body += e.body;
+      last.end_depth = e.end_depth;
+      last.after_token = e.after_token;
+      return;
+    }
+    pending.push_back(std::move(e));
+  };
+
+  // Replaces old children [f.o, j) by new ones [f.run, l).
+  const auto replace = [&](frame& f, std::size_t j, std::size_t l) {
+    const std::size_t i = f.o, k = f.run;
+    if (i == j && k == l) return;
+    if (!f.noted) out.parents_.push_back(f.p);
+    f.noted = true;
+    detail::pending_edit e;
+    e.depth = f.depth;
+    e.end = j < from.size() ? token_begin(from[j]) : source.size();
+    if (i < j) {
+      e.begin = token_begin(from[i]);
+    } else if (j < f.old_end) {
+      e.begin = e.end; // in front of old child j
+    } else if (j == 0) {
+      e.begin = 0; // the old document is empty
+    } else {
+      // After the last old child, or after the parent if it had none.
+      const node& x = from[j - 1];
+      e.begin = token_end(x);
+      e.append = true;
+      detail::write_step(e.lead, x.depth, true, f.depth);
+    }
+    output_buffer body;
+    for (std::size_t c = k; c < l; ++c) {
+      if (c > k) detail::write_transition(body, to[c - 1].depth, to[c].depth);
+      write_node(body, to, c);
+    }
+    e.body = body.release();
+    e.after_token = k < l;
+    e.end_depth = k < l ? to[l - 1].depth : f.depth;
+    e.closes = j < from.size();
+    e.target = e.closes ? from[j].depth : 0;
+    add(std::move(e));
+  };
+
+  open(element::root_index, element::root_index);
+  while (!stack.empty()) {
+    frame& f = stack.back();
+    if (f.n == f.new_end) {
+      replace(f, f.old_end, f.new_end);
+      stack.pop_back();
+      continue;
+    }
+    const std::size_t n = f.n;
+    f.n = static_cast<std::size_t>(to[n].next);
+    const std::string_view key = to.value(n, scratch);
+    std::size_t c = element::root_index;
+    if (f.o < f.old_end && from.key_equals(f.o, key)) {
+      c = f.o;
+    } else {
+      c = find_old(f, key);
+      if (c != element::root_index && c < f.o) c = element::root_index;
+    }
+    if (c == element::root_index) continue;
+    replace(f, c, n);
+    f.o = static_cast<std::size_t>(from[c].next);
+    f.run = f.n;
+    // Last, since it moves `f`.
+    if (old_hash[c] != new_hash[n] ||
+        (options.verify && !detail::same_subtree(from, c, to, n)))
+      open(c, n);
+  }
+
+  for (const detail::pending_edit& e : pending) {
+    std::string text = e.lead + e.body;
+    if (e.closes) detail::write_step(text, e.end_depth, e.after_token, e.target);
+    out.edits_.push_back({e.begin, e.end - e.begin, text.size()});
+    out.text_ += text;
+  }
+  return out;
+}
+
+// Applies `p` to `doc`, which must hold the document the patch was made
+// from. `out` receives the patched source, and the tape is brought up to date
+// in place with papr::reparse. The document views `out` afterwards. Its
+// current source must stay readable during the call, so `out` cannot be that
+// source. Fails with patch_mismatch, leaving the document alone, when the
+// edits do not fit its source.
+//
+// Edits close together are re-lexed as one span. Groups of them far apart
+// are applied one after another, so the text between them is only shifted.
+// Each group costs a copy of the source, so beyond a few groups one pass
+// over everything from the first edit to the last is cheaper.
+inline status apply(const patch& p, document& doc, std::string& out,
+                    backend scan = backend::automatic,
+                    std::uint32_t max_depth = default_max_depth) {
+  PAPR_TRACE_SCOPE("papr::apply");
+  constexpr std::size_t group_gap = std::size_t{1} << 20;
+  constexpr std::size_t max_groups = 8;
+  const std::string_view base = doc.source();
+  const std::span<const edit> edits = p.edits();
+  if (base.size() != p.base_size()) return {error_code::patch_mismatch, 0};
+  // Where each group of edits starts.
+  std::vector<std::size_t> groups;
+  std::size_t at = 0, text = 0;
+  for (std::size_t i = 0; i < edits.size(); ++i) {
+    const edit& e = edits[i];
+    if (e.offset < at || e.removed > base.size() - e.offset || e.inserted > p.text().size() - text)
+      return {error_code::patch_mismatch, e.offset};
+    if (i == 0 || e.offset - at > group_gap) groups.push_back(i);
+    at = e.offset + e.removed;
+    text += e.inserted;
+  }
+  if (groups.size() > max_groups) groups.resize(1);
+  if (groups.empty()) {
+    out.assign(base);
+    return reparse(doc, out, {}, scan, max_depth);
+  }
+
+  // Each group goes from the text the document views to the other buffer;
+  // the last one has to land in `out`.
+  std::string spare;
+  text = 0;
+  for (std::size_t g = 0; g < groups.size(); ++g) {
+    std::string& next = (groups.size() - g) % 2 == 1 ? out : spare;
+    const std::string_view current = doc.source();
+    const std::size_t stop = g + 1 < groups.size() ? groups[g + 1] : edits.size();
+    // The text before this group's first edit already holds the earlier
+    // groups; what follows it is still the base text, shifted by as much.
+    const std::size_t first = edits[groups[g]].offset;
+    const std::size_t lead = first + current.size() - base.size();
+    next.clear();
+    next.reserve(current.size() + p.text().size());
+    next.append(current.substr(0, lead));
+    std::size_t from = first;
+    for (std::size_t i = groups[g]; i < stop; ++i) {
+      const edit& e = edits[i];
+      next.append(base.substr(from, e.offset - from));
+      next.append(p.text().substr(text, e.inserted));
+      text += e.inserted;
+      from = e.offset + e.removed;
+    }
+    const edit change{lead, from - first, next.size() - lead};
+    next.append(base.substr(from));
+    if (status st = reparse(doc, next, change, scan, max_depth); !st.ok()) return st;
+  }
+  return {};
+}
+
+} // namespace papr
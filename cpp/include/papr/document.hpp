@@ -0,0 +1,734 @@
+// papr - document.hpp
+// The parsed document: a flat tape of nodes in source order.
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "convert.hpp"
+#include "error.hpp"
+#include "escape.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "stats.hpp"
+#include "symbols.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// One token of the document. Nodes are stored in the order their tokens appear
+// in the source, so a node's children follow it directly and its whole subtree
+// is the contiguous range [index, next). When next is not the end of the
+// parent's subtree it is the index of the next sibling.
+struct node {
+  enum flag : std::uint32_t { quoted = token::quoted, escaped = token::escaped };
+
+  std::uint64_t offset = 0; // start of the token text in the source
+  std::uint64_t length = 0; // length of the token text
+  std::uint64_t next = 0;   // one past the last node of this subtree
+  std::uint32_t depth = 0;  // depth given by Rules 1-3, top level is 0
+  std::uint32_t flags = 0;
+
+  static constexpr std::uint32_t max_depth = ~std::uint32_t{0};
+};
+
+// One slot of the key index, an open-addressing table over (parent, value).
+struct index_slot {
+  static constexpr std::uint64_t empty = ~std::uint64_t{0};
+
+  std::uint64_t hash = 0;
+  std::uint64_t node = empty;
+};
+
+// The heap bytes a document holds, by what they are for. Vectors count their
+// capacity and hash maps an estimate of their buckets and entries. The source
+// is not counted, since the document only views it, and neither is the tape
+// of a document loaded from a .paprb image, which lives in the image.
+struct memory_usage {
+  std::size_t nodes = 0;    // the tape
+  std::size_t decoded = 0;  // escaped tokens decoded by value(i)
+  std::size_t index = 0;    // the key index
+  std::size_t symbols = 0;  // symbol ids and the symbol table
+  std::size_t comments = 0; // comment ranges
+  std::size_t hashes = 0;   // subtree hashes
+
+  constexpr std::size_t total() const noexcept {
+    return nodes + decoded + index + symbols + comments + hashes;
+  }
+};
+
+template <class Node>
+class basic_document;
+
+namespace detail {
+struct document_access;
+} // namespace detail
+
+// A cheap handle to one node of a document, or to the document root whose
+// children are the depth-0 tokens. A default-constructed element is invalid;
+// lookups that find nothing return one so calls can be chained.
+template <class Node>
+class basic_element {
+public:
+  class iterator;
+  struct range;
+
+  basic_element() = default;
+
+  constexpr bool valid() const noexcept { return doc_ != nullptr; }
+  constexpr explicit operator bool() const noexcept { return valid(); }
+  constexpr bool is_root() const noexcept { return index_ == root_index; }
+  constexpr std::size_t index() const noexcept { return index_; }
+
+  // The token text as it appears in the source (between the quotes for a
+  // quoted token, with escapes left in place).
+  std::string_view raw() const noexcept;
+  // The token's value; see document::value for where escaped tokens are
+  // decoded to.
+  std::string_view value() const;
+  std::string_view value(std::string& scratch) const;
+
+  std::uint32_t depth() const noexcept;
+  bool is_quoted() const noexcept;
+  bool has_escapes() const noexcept;
+
+  // The value converted to T, or nothing if it does not convert.
+  template <scalar_value T>
+  std::optional<T> as() const noexcept;
+  // The children converted to T into `buffer`, e.g. versions: 10, 11 as
+  // int64_t. Nothing if a child does not convert or the buffer is too small;
+  // document::convert_children reports which.
+  template <scalar_value T>
+  std::optional<std::span<const T>> as(std::span<T> buffer) const noexcept;
+
+  bool has_children() const noexcept;
+  basic_element first_child() const noexcept;
+  basic_element next_sibling() const noexcept;
+  range children() const noexcept;
+
+  // The first child whose value equals `key`.
+  basic_element find(std::string_view key) const noexcept;
+  basic_element operator[](std::string_view key) const noexcept { return find(key); }
+  // find() with hash_bytes(key) already known.
+  basic_element find(std::string_view key, std::uint64_t value_hash) const noexcept;
+  // The first child with symbol id `symbol`; see document::intern.
+  basic_element find_symbol(std::uint32_t symbol) const noexcept;
+  // This token's symbol id, or symbol_table::none if the document is not
+  // interned.
+  std::uint32_t symbol() const noexcept;
+
+  // Follows a key path fixed at compile time: get<"a", "b">() is
+  // find("a").find("b"), with both hashes computed by the compiler.
+  template <fixed_string... Keys>
+  basic_element get() const noexcept {
+    basic_element e = *this;
+    ((e = e.find(Keys.view(), Keys.hash)), ...);
+    return e;
+  }
+
+  static constexpr std::size_t root_index = static_cast<std::size_t>(-1);
+
+private:
+  friend class basic_document<Node>;
+  constexpr basic_element(const basic_document<Node>* doc, std::size_t index) noexcept
+      : doc_(doc), index_(index) {}
+
+  constexpr bool is_node() const noexcept {
+    return doc_ != nullptr && index_ != root_index;
+  }
+
+  const basic_document<Node>* doc_ = nullptr;
+  std::size_t index_ = 0;
+};
+
+// Walks a run of siblings by following node::next, so stepping over a child
+// never touches the nodes of its subtree.
+template <class Node>
+class basic_element<Node>::iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = basic_element;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = basic_element;
+
+  iterator() = default;
+
+  basic_element operator*() const noexcept { return {doc_, index_}; }
+  iterator& operator++() noexcept;
+  iterator operator++(int) noexcept {
+    iterator old = *this;
+    ++*this;
+    return old;
+  }
+  friend bool operator==(const iterator& a, const iterator& b) noexcept {
+    return a.index_ == b.index_;
+  }
+
+private:
+  friend class basic_element;
+  iterator(const basic_document<Node>* doc, std::size_t index) noexcept
+      : doc_(doc), index_(index) {}
+
+  const basic_document<Node>* doc_ = nullptr;
+  std::size_t index_ = 0;
+};
+
+template <class Node>
+struct basic_element<Node>::range {
+  iterator first, last;
+  iterator begin() const noexcept { return first; }
+  iterator end() const noexcept { return last; }
+  bool empty() const noexcept { return first == last; }
+};
+
+// The in-memory form of a papr file. A document is one contiguous array of
+// nodes plus the source it was parsed from; node text is never copied, so the
+// source has to outlive the document. Build one with papr::parse or a reusable
+// papr::parser (parser.hpp).
+//
+// Everything a document allocates (the tape, decoded strings, indexes) comes
+// from the memory resource it was constructed with. Documents are move-only.
+//
+// `Node` is the layout of the tape: node, or compact_node (compact.hpp) for
+// sources under 4 GiB. Everything else is the same for both.
+template <class Node>
+class basic_document {
+public:
+  using element = basic_element<Node>;
+
+  basic_document() noexcept : basic_document(std::pmr::get_default_resource()) {}
+  explicit basic_document(std::pmr::memory_resource* resource) noexcept
+      : resource_(resource),
+        nodes_(resource),
+        index_(resource),
+        key_ids_(resource),
+        symbols_(resource),
+        symbol_table_(resource),
+        comments_(resource),
+        hashes_(resource),
+        decoded_(resource) {}
+
+  basic_document(const basic_document&) = delete;
+  basic_document& operator=(const basic_document&) = delete;
+  basic_document(basic_document&& other) noexcept
+      : resource_(other.resource_),
+        source_(other.source_),
+        nodes_(std::move(other.nodes_)),
+        index_(std::move(other.index_)),
+        key_ids_(std::move(other.key_ids_)),
+        next_key_id_(std::exchange(other.next_key_id_, 0)),
+        tape_(std::exchange(other.tape_, {})),
+        table_(std::exchange(other.table_, {})),
+        symbols_(std::move(other.symbols_)),
+        symbol_table_(std::move(other.symbol_table_)),
+        interned_(std::exchange(other.interned_, false)),
+        comments_(std::move(other.comments_)),
+        keeps_comments_(std::exchange(other.keeps_comments_, false)),
+        hashes_(std::move(other.hashes_)),
+        hashed_(std::exchange(other.hashed_, false)),
+        decoded_(std::move(other.decoded_)) {
+    other.nodes_.clear();
+    other.index_.clear();
+    other.key_ids_.clear();
+    other.symbols_.clear();
+    other.symbol_table_.clear();
+    other.comments_.clear();
+    other.hashes_.clear();
+    other.decoded_.clear();
+  }
+  basic_document& operator=(basic_document&& other) noexcept {
+    if (this != &other) {
+      std::destroy_at(this);
+      std::construct_at(this, std::move(other));
+    }
+    return *this;
+  }
+  ~basic_document() { release_decoded(); }
+
+  std::pmr::memory_resource* resource() const noexcept { return resource_; }
+
+  std::string_view source() const noexcept { return source_; }
+  std::span<const Node> nodes() const noexcept { return tape_; }
+  std::size_t size() const noexcept { return tape_.size(); }
+  bool empty() const noexcept { return tape_.empty(); }
+  const Node& operator[](std::size_t i) const noexcept { return tape_[i]; }
+
+  element root() const noexcept { return {this, element::root_index}; }
+
+  // A key path from the root, e.g. doc.get<"Buttons", "1", "icon">().
+  template <fixed_string... Keys>
+  element get() const noexcept {
+    return root().template get<Keys...>();
+  }
+  element at(std::size_t i) const noexcept { return {this, i}; }
+
+  std::string_view raw(std::size_t i) const noexcept {
+    const Node& n = tape_[i];
+    return source_.substr(static_cast<std::size_t>(n.offset),
+                          static_cast<std::size_t>(n.length));
+  }
+
+  // The value of token `i`. Escaped tokens are decoded on first read into
+  // memory from the document's resource and cached, so this is not safe to
+  // call concurrently on a document that has not been materialize()d; the
+  // overloads below never touch the cache. Once a token is cached, reading
+  // it only looks it up.
+  std::string_view value(std::size_t i) const {
+    if (!(tape_[i].flags & node::escaped)) return raw(i);
+    if (const auto it = decoded_.find(i); it != decoded_.end()) return it->second;
+    const std::string_view text = decode_into(i, *resource_);
+    decoded_.emplace(i, text);
+    return text;
+  }
+
+  std::string_view value(std::size_t i, std::string& scratch) const {
+    if (!(tape_[i].flags & node::escaped)) return raw(i);
+    scratch.resize(static_cast<std::size_t>(tape_[i].length));
+    scratch.resize(unescape(raw(i), scratch.data()));
+    return scratch;
+  }
+
+  // Decodes into memory from `out`, which the caller owns and frees.
+  std::string_view value(std::size_t i, std::pmr::memory_resource& out) const {
+    if (!(tape_[i].flags & node::escaped)) return raw(i);
+    return decode_into(i, out);
+  }
+
+  // Decodes every escaped token up front, after which value(i) only reads.
+  void materialize() const {
+    for (std::size_t i = 0; i < tape_.size(); ++i)
+      if (tape_[i].flags & node::escaped) value(i);
+  }
+
+  bool key_equals(std::size_t i, std::string_view key) const noexcept {
+    if (tape_[i].flags & node::escaped) return unescaped_equals(raw(i), key);
+    return raw(i) == key;
+  }
+
+  // Converts token `i` to T. Escaped tokens never convert: an escape leaves
+  // a `"` or `\` in the value, which no number or boolean contains.
+  template <scalar_value T>
+  bool convert(std::size_t i, T& out) const noexcept {
+    return !(tape_[i].flags & node::escaped) && papr::convert(raw(i), out);
+  }
+
+  // Converts the children of `parent` (possibly the root) into `out` in one
+  // pass over the tape, and sets `count` to how many there are. Fails with
+  // invalid_value at the first token that does not convert, or with
+  // buffer_too_small when there are more than out.size() children; `count`
+  // is still the full number then, so the caller can size a retry.
+  template <scalar_value T>
+  status convert_children(std::size_t parent, std::span<T> out,
+                          std::size_t& count) const noexcept {
+    const std::size_t end = children_end(parent);
+    count = 0;
+    for (std::size_t c = children_begin(parent); c < end;
+         c = static_cast<std::size_t>(tape_[c].next), ++count) {
+      if (count >= out.size()) continue;
+      if (!convert(c, out[count]))
+        return {error_code::invalid_value, static_cast<std::size_t>(tape_[c].offset)};
+    }
+    if (count > out.size()) return {error_code::buffer_too_small, 0};
+    return {};
+  }
+
+  // The half-open range of node indices holding the children of `i`, which
+  // may be element::root_index.
+  std::size_t children_begin(std::size_t i) const noexcept {
+    return i == element::root_index ? 0 : i + 1;
+  }
+  std::size_t children_end(std::size_t i) const noexcept {
+    return i == element::root_index ? tape_.size()
+                                    : static_cast<std::size_t>(tape_[i].next);
+  }
+
+  // True when `c` is a direct child of `parent` (possibly the root).
+  bool is_child(std::size_t c, std::size_t parent) const noexcept {
+    if (parent == element::root_index) return tape_[c].depth == 0;
+    return c > parent && c < tape_[parent].next &&
+           tape_[c].depth == tape_[parent].depth + 1;
+  }
+
+  // The first child of `parent` whose value is `key`, or element::root_index.
+  // With a key index this is a hash probe; without one it is a linear scan
+  // that hops from sibling to sibling.
+  std::size_t find_child(std::size_t parent, std::string_view key) const noexcept {
+    if (!table_.empty() || interned_) return find_child(parent, key, hash_bytes(key));
+    const std::size_t end = children_end(parent);
+    for (std::size_t c = children_begin(parent); c < end;
+         c = static_cast<std::size_t>(tape_[c].next))
+      if (key_equals(c, key)) return c;
+    return element::root_index;
+  }
+
+  // The same lookup with hash_bytes(key) already computed. An interned
+  // document finds the key's symbol with that hash too, so a compile-time key
+  // is never hashed at run time.
+  std::size_t find_child(std::size_t parent, std::string_view key,
+                         std::uint64_t value_hash) const noexcept {
+    if (table_.empty() && !interned_) return find_child(parent, key);
+    const std::uint32_t symbol =
+        interned_ ? symbol_table_.find(key, value_hash) : symbol_table::none;
+    if (interned_ && symbol == symbol_table::none) return element::root_index;
+    if (table_.empty()) return find_symbol(parent, symbol);
+    const std::uint64_t h = key_hash(key_id(parent), value_hash);
+    const std::size_t mask = table_.size() - 1;
+    for (std::size_t slot = h & mask;; slot = (slot + 1) & mask) {
+      const index_slot& s = table_[slot];
+      if (s.node == index_slot::empty) return element::root_index;
+      const auto c = static_cast<std::size_t>(s.node);
+      if (s.hash == h && is_child(c, parent) &&
+          (interned_ ? symbols_[c] == symbol : key_equals(c, key)))
+        return c;
+    }
+  }
+
+  // The first child of `parent` with symbol id `symbol`. Siblings are told
+  // apart by comparing ids, never text, so resolving a key with
+  // symbols().find once and reusing the id across many records costs one
+  // integer compare per sibling.
+  std::size_t find_symbol(std::size_t parent, std::uint32_t symbol) const noexcept {
+    if (!interned_ || symbol == symbol_table::none) return element::root_index;
+    const std::size_t end = children_end(parent);
+    for (std::size_t c = children_begin(parent); c < end;
+         c = static_cast<std::size_t>(tape_[c].next))
+      if (symbols_[c] == symbol) return c;
+    return element::root_index;
+  }
+
+  // Interning mode: every distinct value is stored once in the document's
+  // symbol table and each node gets its 32-bit id, four bytes per node next to
+  // the tape. Lookups then compare ids instead of text; a key that occurs
+  // nowhere in the document is rejected by one hash probe. Escaped tokens are
+  // interned decoded. The table holds copies of the values, so it stays valid
+  // when reparse moves the document to a new source.
+  void intern() {
+    symbols_.clear();
+    symbol_table_.clear();
+    symbols_.resize(tape_.size());
+    intern_nodes(0, tape_.size());
+    interned_ = true;
+  }
+
+  bool is_interned() const noexcept { return interned_; }
+  const symbol_table& symbols() const noexcept { return symbol_table_; }
+  std::uint32_t symbol(std::size_t i) const noexcept {
+    return interned_ ? symbols_[i] : symbol_table::none;
+  }
+
+  // Builds the key index: one slot per node, keyed by its parent and its
+  // value, at a load factor of at most one half. The table is sized once up
+  // front and lives in the document's memory resource. Later lookups through
+  // find_child and element::find use it automatically.
+  void build_index() {
+    PAPR_TRACE_SCOPE("papr::build_index");
+    PAPR_STAT_ADD(index_builds, 1);
+    const std::size_t capacity = std::bit_ceil(std::max<std::size_t>(tape_.size() * 2, 8));
+    index_.assign(capacity, index_slot{});
+    key_ids_.clear();
+    std::pmr::vector<std::size_t> path(resource_); // latest node at each depth
+    std::string scratch;
+    for (std::size_t i = 0; i < tape_.size(); ++i) {
+      const std::uint32_t d = tape_[i].depth;
+      if (path.size() <= d) path.resize(d + 1);
+      path[d] = i;
+      const std::size_t parent = d == 0 ? element::root_index : path[d - 1];
+      const std::string_view key = value(i, scratch);
+      insert_key(i, parent, key, key_hash(parent, hash_bytes(key)));
+    }
+    table_ = index_;
+  }
+
+  bool has_index() const noexcept { return !table_.empty(); }
+
+  // The comments of the source in order, when it was parsed with comments
+  // kept (parser::set_keep_comments); the tape never holds them.
+  std::span<const comment_range> comments() const noexcept { return comments_; }
+  bool keeps_comments() const noexcept { return keeps_comments_; }
+
+  // A 64-bit hash of the subtree of node `i`, made of its value, its
+  // children's hashes and positions in order, and its size (see
+  // subtree_combine), so equal subtrees hash equally within and across
+  // documents. Unequal ones collide only by chance, but they can: code that
+  // cannot afford that should compare subtrees on a match, as diff does with
+  // diff_options::verify.
+  // Values are hashed decoded: a token and its quoted spelling agree. Only
+  // there when the parse was asked for it (parser::set_hash_subtrees) or
+  // after hash_subtrees().
+  std::uint64_t subtree_hash(std::size_t i) const noexcept { return hashes_[i]; }
+  std::span<const std::uint64_t> subtree_hashes() const noexcept { return hashes_; }
+  bool has_subtree_hashes() const noexcept { return hashed_; }
+
+  // Computes every subtree hash in one backward pass over the tape, for a
+  // document that was not hashed while it was parsed.
+  void hash_subtrees() {
+    hashes_.assign(tape_.size(), 0);
+    std::string scratch;
+    for (std::size_t i = tape_.size(); i-- > 0;) rehash(i, scratch);
+    hashed_ = true;
+  }
+
+  papr::memory_usage memory_usage() const noexcept {
+    papr::memory_usage m;
+    m.nodes = nodes_.capacity() * sizeof(Node);
+    m.decoded = detail::hash_map_bytes(decoded_);
+    for (const auto& [i, text] : decoded_) m.decoded += static_cast<std::size_t>(tape_[i].length);
+    m.index = index_.capacity() * sizeof(index_slot) +
+              key_ids_.capacity() * sizeof(std::uint64_t);
+    m.symbols = symbols_.capacity() * sizeof(std::uint32_t) + symbol_table_.memory_usage();
+    m.comments = comments_.capacity() * sizeof(comment_range);
+    m.hashes = hashes_.capacity() * sizeof(std::uint64_t);
+    return m;
+  }
+
+  void clear() noexcept {
+    release_decoded();
+    source_ = {};
+    nodes_.clear();
+    index_.clear();
+    key_ids_.clear();
+    tape_ = {};
+    table_ = {};
+    symbols_.clear();
+    symbol_table_.clear();
+    interned_ = false;
+    comments_.clear();
+    keeps_comments_ = false;
+    hashes_.clear();
+    hashed_ = false;
+  }
+
+private:
+  friend struct detail::document_access;
+
+  std::string_view decode_into(std::size_t i, std::pmr::memory_resource& out) const {
+    const std::string_view text = raw(i);
+    char* buffer = static_cast<char*>(out.allocate(text.size(), 1));
+    return {buffer, unescape(text, buffer)};
+  }
+
+  // Adds node `i` to the key index under hash `h`. Only the first of several
+  // equal siblings is reachable by key, so an entry for a later one is
+  // replaced and an entry for an earlier one is kept.
+  void insert_key(std::size_t i, std::size_t parent, std::string_view key,
+                  std::uint64_t h) noexcept {
+    const std::size_t mask = index_.size() - 1;
+    for (std::size_t slot = h & mask;; slot = (slot + 1) & mask) {
+      index_slot& s = index_[slot];
+      if (s.node == index_slot::empty) {
+        s = {h, i};
+        return;
+      }
+      const auto c = static_cast<std::size_t>(s.node);
+      if (s.hash == h && is_child(c, parent) && key_equals(c, key)) {
+        if (i < c) s.node = i;
+        return;
+      }
+    }
+  }
+
+  // The number the key index files the children of `parent` under: its tape
+  // index, until reparse renumbers the tape under an index. Each node then
+  // keeps the id it had, new nodes get new ones, and only the node numbers in
+  // the slots need updating.
+  std::uint64_t key_id(std::size_t parent) const noexcept {
+    return parent == element::root_index || key_ids_.empty() ? parent : key_ids_[parent];
+  }
+
+  // Gives nodes [begin, end) their symbol ids.
+  void intern_nodes(std::size_t begin, std::size_t end) {
+    std::string scratch;
+    for (std::size_t i = begin; i < end; ++i)
+      symbols_[i] = symbol_table_.intern_copy(value(i, scratch));
+  }
+
+  // Recomputes the subtree hash of node `i` from its children's.
+  void rehash(std::size_t i, std::string& scratch) {
+    PAPR_STAT_ADD(rehashes, 1);
+    const auto next = static_cast<std::size_t>(tape_[i].next);
+    std::uint64_t h = subtree_seed(value(i, scratch));
+    for (std::size_t c = i + 1; c < next; c = static_cast<std::size_t>(tape_[c].next))
+      h = subtree_combine(h, hashes_[c], c - i);
+    hashes_[i] = subtree_finish(h, next - i);
+  }
+
+  // Removes the entry for node `i`, filed under hash `h`, and says whether
+  // there was one. Later entries of the probe run are shifted back over the
+  // hole so that no tombstones are needed.
+  bool erase_key(std::size_t i, std::uint64_t h) noexcept {
+    const std::size_t mask = index_.size() - 1;
+    std::size_t hole = h & mask;
+    for (;; hole = (hole + 1) & mask) {
+      if (index_[hole].node == index_slot::empty) return false;
+      if (index_[hole].node == i) break;
+    }
+    for (std::size_t slot = (hole + 1) & mask; index_[slot].node != index_slot::empty;
+         slot = (slot + 1) & mask) {
+      const std::size_t home = index_[slot].hash & mask;
+      if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+        index_[hole] = index_[slot];
+        hole = slot;
+      }
+    }
+    index_[hole] = index_slot{};
+    return true;
+  }
+
+  void release_decoded() noexcept {
+    for (const auto& [i, text] : decoded_)
+      resource_->deallocate(const_cast<char*>(text.data()),
+                            static_cast<std::size_t>(tape_[i].length), 1);
+    decoded_.clear();
+  }
+
+  std::pmr::memory_resource* resource_;
+  std::string_view source_;
+  std::pmr::vector<Node> nodes_;
+  std::pmr::vector<index_slot> index_;
+  // Key ids by node index, empty while every node's is its index; see key_id.
+  std::pmr::vector<std::uint64_t> key_ids_;
+  std::uint64_t next_key_id_ = 0;
+  // What every read goes through: nodes_ and index_ for a document that was
+  // parsed, or memory the document does not own for one that was loaded
+  // (binary.hpp).
+  std::span<const Node> tape_;
+  std::span<const index_slot> table_;
+  // Symbol ids by node index, empty unless intern() was called.
+  std::pmr::vector<std::uint32_t> symbols_;
+  symbol_table symbol_table_;
+  bool interned_ = false;
+  std::pmr::vector<comment_range> comments_;
+  bool keeps_comments_ = false;
+  // Subtree hashes by node index, empty unless asked for.
+  std::pmr::vector<std::uint64_t> hashes_;
+  bool hashed_ = false;
+  // Escaped tokens decoded so far, by node index.
+  mutable std::pmr::unordered_map<std::size_t, std::string_view> decoded_;
+};
+
+using element = basic_element<node>;
+using document = basic_document<node>;
+
+template <class Node>
+std::string_view basic_element<Node>::raw() const noexcept {
+  return is_node() ? doc_->raw(index_) : std::string_view{};
+}
+
+template <class Node>
+std::string_view basic_element<Node>::value() const {
+  return is_node() ? doc_->value(index_) : std::string_view{};
+}
+
+template <class Node>
+std::string_view basic_element<Node>::value(std::string& scratch) const {
+  return is_node() ? doc_->value(index_, scratch) : std::string_view{};
+}
+
+template <class Node>
+std::uint32_t basic_element<Node>::depth() const noexcept {
+  return is_node() ? (*doc_)[index_].depth : 0;
+}
+
+template <class Node>
+bool basic_element<Node>::is_quoted() const noexcept {
+  return is_node() && ((*doc_)[index_].flags & node::quoted);
+}
+
+template <class Node>
+bool basic_element<Node>::has_escapes() const noexcept {
+  return is_node() && ((*doc_)[index_].flags & node::escaped);
+}
+
+template <class Node>
+template <scalar_value T>
+std::optional<T> basic_element<Node>::as() const noexcept {
+  T out{};
+  if (!is_node() || !doc_->convert(index_, out)) return std::nullopt;
+  return out;
+}
+
+template <class Node>
+template <scalar_value T>
+std::optional<std::span<const T>> basic_element<Node>::as(
+    std::span<T> buffer) const noexcept {
+  std::size_t count = 0;
+  if (!valid() || !doc_->convert_children(index_, buffer, count).ok()) return std::nullopt;
+  return std::span<const T>(buffer.data(), count);
+}
+
+template <class Node>
+bool basic_element<Node>::has_children() const noexcept {
+  return valid() && doc_->children_begin(index_) < doc_->children_end(index_);
+}
+
+template <class Node>
+basic_element<Node> basic_element<Node>::first_child() const noexcept {
+  if (!has_children()) return {};
+  return {doc_, doc_->children_begin(index_)};
+}
+
+template <class Node>
+basic_element<Node> basic_element<Node>::next_sibling() const noexcept {
+  if (!is_node()) return {};
+  const auto next = static_cast<std::size_t>((*doc_)[index_].next);
+  if (next >= doc_->size() || (*doc_)[next].depth != depth()) return {};
+  return {doc_, next};
+}
+
+template <class Node>
+auto basic_element<Node>::children() const noexcept -> range {
+  if (!valid()) return {};
+  return {{doc_, doc_->children_begin(index_)},
+          {doc_, doc_->children_end(index_)}};
+}
+
+template <class Node>
+basic_element<Node> basic_element<Node>::find(std::string_view key) const noexcept {
+  if (!valid()) return {};
+  const std::size_t c = doc_->find_child(index_, key);
+  if (c == root_index) return {};
+  return {doc_, c};
+}
+
+template <class Node>
+basic_element<Node> basic_element<Node>::find(std::string_view key,
+                                             std::uint64_t value_hash) const noexcept {
+  if (!valid()) return {};
+  const std::size_t c = doc_->find_child(index_, key, value_hash);
+  if (c == root_index) return {};
+  return {doc_, c};
+}
+
+template <class Node>
+basic_element<Node> basic_element<Node>::find_symbol(std::uint32_t symbol) const noexcept {
+  if (!valid()) return {};
+  const std::size_t c = doc_->find_symbol(index_, symbol);
+  if (c == root_index) return {};
+  return {doc_, c};
+}
+
+template <class Node>
+std::uint32_t basic_element<Node>::symbol() const noexcept {
+  return is_node() ? doc_->symbol(index_) : symbol_table::none;
+}
+
+template <class Node>
+auto basic_element<Node>::iterator::operator++() noexcept -> iterator& {
+  index_ = static_cast<std::size_t>((*doc_)[index_].next);
+  return *this;
+}
+
+} // namespace papr
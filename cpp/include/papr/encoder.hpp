@@ -0,0 +1,232 @@
+// papr - encoder.hpp
+// Push-style writing of papr text, and sinks that flush it in fixed chunks.
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include "convert.hpp"
+#include "error.hpp"
+#include "writer.hpp"
+
+namespace papr {
+
+// Something a chunked_sink hands full chunks to. A failed status stops the
+// sink; it is reported by every later flush().
+template <class F>
+concept chunk_consumer = requires(F& f, std::string_view chunk) {
+  { f(chunk) } -> std::convertible_to<status>;
+};
+
+// A sink that gathers output into a buffer of `chunk_size` bytes and passes
+// it on whenever it is full, so output of any length is written in pieces of
+// the same size, plus a shorter last one. Memory use never grows past the
+// one buffer.
+template <chunk_consumer Consumer>
+class chunked_sink {
+public:
+  static constexpr std::size_t default_chunk_size = 64 * 1024;
+
+  explicit chunked_sink(Consumer consumer, std::size_t chunk_size = default_chunk_size)
+      : consumer_(std::move(consumer)), chunk_size_(chunk_size ? chunk_size : 1) {
+    buffer_.reserve(chunk_size_);
+  }
+  chunked_sink(const chunked_sink&) = delete;
+  chunked_sink& operator=(const chunked_sink&) = delete;
+  // Flushes what is left; call flush() first to find out whether that worked.
+  ~chunked_sink() { flush(); }
+
+  void write(std::string_view bytes) {
+    while (!bytes.empty()) {
+      const std::size_t n = std::min(bytes.size(), chunk_size_ - buffer_.size());
+      buffer_.append(bytes.data(), n);
+      bytes.remove_prefix(n);
+      if (buffer_.size() == chunk_size_) pass_on();
+    }
+  }
+  void write(char c) { write(std::string_view(&c, 1)); }
+
+  // Hands over whatever is buffered, even less than a chunk, and reports the
+  // first failure of the consumer, if any.
+  status flush() {
+    if (!buffer_.empty()) pass_on();
+    return error_;
+  }
+
+  // Bytes handed to the consumer so far.
+  std::uint64_t flushed() const noexcept { return flushed_; }
+  status error() const noexcept { return error_; }
+
+private:
+  void pass_on() {
+    if (error_.ok()) {
+      error_ = consumer_(std::string_view(buffer_));
+      flushed_ += buffer_.size();
+    }
+    buffer_.clear();
+  }
+
+  Consumer consumer_;
+  std::size_t chunk_size_;
+  std::string buffer_;
+  std::uint64_t flushed_ = 0;
+  status error_;
+};
+
+#if !defined(_WIN32)
+// Writes each chunk to a file descriptor, which it does not own.
+struct fd_consumer {
+  int fd = -1;
+
+  status operator()(std::string_view chunk) const noexcept {
+    while (!chunk.empty()) {
+      const ssize_t n = ::write(fd, chunk.data(), chunk.size());
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return {error_code::io_error, 0};
+      }
+      chunk.remove_prefix(static_cast<std::size_t>(n));
+    }
+    return {};
+  }
+};
+
+using fd_sink = chunked_sink<fd_consumer>;
+#endif
+
+// Writes papr text as it is described, one call per token or delimiter,
+// without building a document:
+//
+//   enc.begin_key("Buttons").begin_key("1").begin_key("icon").value("a.png");
+//   enc.end().end().next().begin_key("2") ...
+//
+// writes `Buttons:1:icon:a.png;;2:...`. begin_key writes a token and the `:`
+// that opens its level, value writes a token, next writes `,` and end writes
+// the `;` that closes the innermost open level. Tokens are quoted and escaped
+// only when Rule 4 needs it.
+//
+// The encoder keeps track of the depth and refuses calls that would make
+// text papr cannot parse back as written: a token right after a token, `,`
+// with no token in front of it, `;` at depth zero, or `;` right after `:` or
+// `,`, where it would close a level with no token in it. The first such call is
+// recorded with the number of bytes written before it, and every call after
+// it does nothing.
+template <sink Sink>
+class encoder {
+public:
+  explicit encoder(Sink& out) noexcept : out_(out) {}
+
+  encoder& begin_key(std::string_view key) {
+    if (token(key)) delimiter(':', 1);
+    return *this;
+  }
+
+  encoder& value(std::string_view v) {
+    token(v);
+    return *this;
+  }
+  template <scalar_value T>
+  encoder& value(T v) {
+    if constexpr (std::same_as<T, bool>) {
+      token(v ? "true" : "false");
+    } else {
+      char text[64];
+      const std::to_chars_result r = std::to_chars(text, text + sizeof text, v);
+      token(std::string_view(text, static_cast<std::size_t>(r.ptr - text)));
+    }
+    return *this;
+  }
+
+  // Right after end() this writes nothing: the `;` already separates the
+  // closed subtree from the sibling that follows it.
+  encoder& next() {
+    if (closed_) return *this;
+    if (!after_token_) return fail(error_code::missing_token);
+    delimiter(',', 0);
+    return *this;
+  }
+
+  encoder& end() {
+    if (depth_ == 0) return fail(error_code::depth_underflow);
+    if (!after_token_ && !closed_) return fail(error_code::missing_token);
+    delimiter(';', -1);
+    closed_ = true;
+    return *this;
+  }
+
+  // Closes every level still open and reports the first refused call, if
+  // any. Like end(), it refuses to close a level right after `:` or `,`. The
+  // sink is not flushed.
+  status finish() {
+    if (depth_ != 0 && !after_token_ && !closed_) fail(error_code::missing_token);
+    if (!error_.ok()) return error_;
+    detail::write_semicolons(out_, depth_);
+    written_ += depth_;
+    if (depth_ != 0) closed_ = true;
+    depth_ = 0;
+    after_token_ = false;
+    return {};
+  }
+
+  std::uint32_t depth() const noexcept { return depth_; }
+  // Bytes written to the sink so far.
+  std::uint64_t written() const noexcept { return written_; }
+  status error() const noexcept { return error_; }
+
+private:
+  // Passes writes on to the sink and counts them.
+  struct counting {
+    encoder& e;
+    void write(std::string_view bytes) {
+      e.out_.write(bytes);
+      e.written_ += bytes.size();
+    }
+  };
+
+  bool token(std::string_view text) {
+    if (!error_.ok()) return false;
+    if (after_token_) {
+      fail(error_code::expected_delimiter);
+      return false;
+    }
+    counting out{*this};
+    write_token(out, text);
+    after_token_ = true;
+    closed_ = false;
+    return true;
+  }
+
+  void delimiter(char c, int change) {
+    if (!error_.ok()) return;
+    out_.write(std::string_view(&c, 1));
+    ++written_;
+    depth_ += static_cast<std::uint32_t>(change);
+    after_token_ = false;
+    closed_ = false;
+  }
+
+  encoder& fail(error_code code) noexcept {
+    if (error_.ok()) error_ = {code, static_cast<std::size_t>(written_)};
+    return *this;
+  }
+
+  Sink& out_;
+  std::uint64_t written_ = 0;
+  std::uint32_t depth_ = 0;
+  bool after_token_ = false;
+  bool closed_ = false; // the last thing written was `;`
+  status error_;
+};
+
+} // namespace papr
@@ -0,0 +1,89 @@
+// papr - epoch.hpp
+// Epoch-based reclamation for data that readers reach without a lock.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace papr::detail {
+
+// Tells a writer when no reader can still see what it replaced. A reader
+// enters, marking itself active in the current epoch, then loads the shared
+// pointer, and leaves when its guard goes away. A writer swaps the pointer,
+// then advance()s the epoch and retires the old value under the epoch it got
+// back; the value may be freed once that epoch is older than oldest().
+//
+// The marks live in a fixed array of reader slots, one per cache line. A
+// reader claims any free slot with one CAS, starting from a slot picked by
+// its thread id, so the array only has to be as large as the number of
+// reads in flight at once. When every slot is taken, enter() spins until one
+// frees up. Writers must be serialized by the caller.
+class epoch_domain {
+  struct alignas(64) slot {
+    std::atomic<std::uint64_t> epoch{0}; // 0 while free
+  };
+
+public:
+  // Marks one reader active for as long as it lives. Move-only.
+  class guard {
+  public:
+    guard(guard&& other) noexcept : slot_(std::exchange(other.slot_, nullptr)) {}
+    guard& operator=(guard&&) = delete;
+    ~guard() {
+      if (slot_ != nullptr) slot_->epoch.store(0, std::memory_order_release);
+    }
+
+  private:
+    friend class epoch_domain;
+    explicit guard(slot* s) noexcept : slot_(s) {}
+
+    slot* slot_;
+  };
+
+  explicit epoch_domain(std::size_t slots) : slots_(slots ? slots : 1) {}
+  epoch_domain(const epoch_domain&) = delete;
+  epoch_domain& operator=(const epoch_domain&) = delete;
+
+  guard enter() const noexcept {
+    const std::size_t count = slots_.size();
+    std::size_t i = std::hash<std::thread::id>{}(std::this_thread::get_id()) % count;
+    for (std::size_t tried = 0;; i = i + 1 == count ? 0 : i + 1) {
+      std::uint64_t expected = 0;
+      const std::uint64_t e = epoch_.load(std::memory_order_seq_cst);
+      // The mark has to be visible before the reader loads the pointer: a
+      // writer that misses it swapped the pointer first, so the reader gets
+      // the new one.
+      if (slots_[i].epoch.compare_exchange_strong(expected, e, std::memory_order_seq_cst))
+        return guard{&slots_[i]};
+      if (++tried % count == 0) std::this_thread::yield();
+    }
+  }
+
+  // Starts a new epoch after a swap and returns the previous one: a reader
+  // that can still see the old value marked itself with it or an earlier
+  // one, and readers arriving later see only the new value.
+  std::uint64_t advance() noexcept { return epoch_.fetch_add(1, std::memory_order_seq_cst); }
+
+  // The oldest epoch an active reader is marked with, or the largest value
+  // when none is active.
+  std::uint64_t oldest() const noexcept {
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (const slot& s : slots_) {
+      const std::uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+      if (e != 0 && e < oldest) oldest = e;
+    }
+    return oldest;
+  }
+
+private:
+  std::atomic<std::uint64_t> epoch_{1};
+  mutable std::vector<slot> slots_;
+};
+
+} // namespace papr::detail
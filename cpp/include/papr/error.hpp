@@ -0,0 +1,57 @@
+// papr - error.hpp
+// Status codes shared by every parsing entry point.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace papr {
+
+// The parse path never throws. Entry points return an error_code and, where
+// it is useful, expose the byte offset at which the problem was found.
+enum class error_code : std::uint8_t {
+  success = 0,
+  unterminated_quote,   // a `"` complex token runs to the end of the input
+  unterminated_comment, // a `##` comment has no closing `##`
+  unexpected_quote,     // a `"` appears in the middle of a plain token
+  expected_delimiter,   // a finished token is followed by more text
+  missing_token,        // `:` or `,` with no token in front of it
+  depth_underflow,      // `;` would take the depth below zero
+  depth_limit,          // `:` would nest deeper than the configured maximum
+  io_error,             // a file could not be opened, read or mapped
+  invalid_value,        // a token does not convert to the requested type
+  buffer_too_small,     // a caller-provided buffer cannot hold the result
+  invalid_binary,       // a .paprb image is malformed or from another version
+  patch_mismatch,       // a patch does not fit the document it is applied to
+  input_too_large,      // the input is too large for 32-bit offsets
+};
+
+constexpr const char* to_string(error_code code) noexcept {
+  switch (code) {
+    case error_code::success: return "success";
+    case error_code::unterminated_quote: return "unterminated quoted token";
+    case error_code::unterminated_comment: return "unterminated ## comment";
+    case error_code::unexpected_quote: return "unexpected quote inside token";
+    case error_code::expected_delimiter: return "expected ':', ',' or ';'";
+    case error_code::missing_token: return "':' or ',' without a token";
+    case error_code::depth_underflow: return "';' below depth zero";
+    case error_code::depth_limit: return "':' nests deeper than the maximum depth";
+    case error_code::io_error: return "i/o error";
+    case error_code::invalid_value: return "value does not convert to the requested type";
+    case error_code::buffer_too_small: return "output buffer too small";
+    case error_code::invalid_binary: return "invalid .paprb image";
+    case error_code::patch_mismatch: return "patch does not fit the document";
+    case error_code::input_too_large: return "input too large for a compact tape";
+  }
+  return "unknown error";
+}
+
+// The outcome of a parse: an error code and the byte offset it refers to.
+struct status {
+  error_code code = error_code::success;
+  std::size_t offset = 0;
+
+  constexpr bool ok() const noexcept { return code == error_code::success; }
+};
+
+} // namespace papr
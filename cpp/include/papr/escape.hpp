@@ -0,0 +1,59 @@
+// papr - escape.hpp
+// On-demand decoding of quoted tokens that contain escape sequences.
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// Writes the value of the raw text between a token's quotes to `out`, which
+// must have room for raw.size() bytes; decoding only ever shrinks the text.
+// Returns the number of bytes written.
+inline std::size_t unescape(std::string_view raw, char* out) noexcept {
+  const char* src = raw.data();
+  const char* const end = src + raw.size();
+  char* dst = out;
+  while (src < end) {
+    const void* hit = std::memchr(src, '\\', static_cast<std::size_t>(end - src));
+    const char* slash = hit ? static_cast<const char*>(hit) : end;
+    const std::size_t run = static_cast<std::size_t>(slash - src);
+    std::memcpy(dst, src, run);
+    dst += run;
+    src = slash;
+    if (src == end) break;
+    if (src + 1 < end && detail::is_escapable(src[1])) ++src;
+    *dst++ = *src++;
+  }
+  return static_cast<std::size_t>(dst - out);
+}
+
+// Compares the value of raw escaped text with `value` without decoding it
+// anywhere first.
+inline bool unescaped_equals(std::string_view raw, std::string_view value) noexcept {
+  std::size_t j = 0;
+  for (std::size_t i = 0; i < raw.size(); ++i, ++j) {
+    char c = raw[i];
+    if (c == '\\' && i + 1 < raw.size() && detail::is_escapable(raw[i + 1]))
+      c = raw[++i];
+    if (j == value.size() || value[j] != c) return false;
+  }
+  return j == value.size();
+}
+
+// Returns the value of a text token. Tokens without escapes come back as the
+// view they already are, so the common case costs nothing. Escaped tokens are
+// decoded into `buffer`, replacing its contents, and the returned view is only
+// valid until the buffer is modified again.
+inline std::string_view decode(const token& tok, std::string& buffer) {
+  if (!tok.has_escapes()) return tok.text;
+  buffer.resize(tok.text.size());
+  buffer.resize(unescape(tok.text, buffer.data()));
+  return buffer;
+}
+
+} // namespace papr
@@ -0,0 +1,113 @@
+// papr - hash.hpp
+// The 64-bit hashes used by the key index and for subtrees.
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+namespace papr {
+
+namespace detail {
+
+inline constexpr std::uint64_t hash_k0 = 0x9e3779b97f4a7c15ull;
+inline constexpr std::uint64_t hash_k1 = 0xbf58476d1ce4e5b9ull;
+inline constexpr std::uint64_t hash_k2 = 0x94d049bb133111ebull;
+
+// The splitmix64 finalizer.
+constexpr std::uint64_t mix(std::uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= hash_k1;
+  x ^= x >> 27;
+  x *= hash_k2;
+  x ^= x >> 31;
+  return x;
+}
+
+// The inverse of x * k modulo 2^64 for odd k, by Newton's iteration: each
+// step doubles the number of correct low bits.
+constexpr std::uint64_t inverse(std::uint64_t k) noexcept {
+  std::uint64_t x = k; // correct to 3 bits for any odd k
+  for (int i = 0; i < 5; ++i) x *= 2 - k * x;
+  return x;
+}
+
+// mix undone, step by step: a shift-xor by s is undone by xoring in every
+// further multiple of s, and a multiply by multiplying by the inverse.
+constexpr std::uint64_t unmix(std::uint64_t x) noexcept {
+  x ^= (x >> 31) ^ (x >> 62);
+  x *= inverse(hash_k2);
+  x ^= (x >> 27) ^ (x >> 54);
+  x *= inverse(hash_k1);
+  x ^= (x >> 30) ^ (x >> 60);
+  return x;
+}
+
+static_assert(unmix(mix(0x0123456789abcdefull)) == 0x0123456789abcdefull);
+
+// Little-endian load of up to eight bytes, usable in constant expressions.
+constexpr std::uint64_t load_word(const char* p, std::size_t n) noexcept {
+  if (std::endian::native == std::endian::little && !std::is_constant_evaluated() &&
+      n == 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p, 8);
+    return w;
+  }
+  std::uint64_t w = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    w |= std::uint64_t{static_cast<unsigned char>(p[i])} << (8 * i);
+  return w;
+}
+
+} // namespace detail
+
+// Hashes a byte string eight bytes at a time. It is constexpr so that keys
+// spelled out in code can be hashed at compile time and compared against
+// hashes computed while parsing.
+constexpr std::uint64_t hash_bytes(std::string_view s, std::uint64_t seed = 0) noexcept {
+  const char* p = s.data();
+  std::size_t n = s.size();
+  std::uint64_t h = seed ^ (n * detail::hash_k0);
+  for (; n >= 8; p += 8, n -= 8)
+    h = (h ^ detail::mix(detail::load_word(p, 8))) * detail::hash_k0;
+  if (n > 0) h = (h ^ detail::mix(detail::load_word(p, n))) * detail::hash_k0;
+  return detail::mix(h);
+}
+
+// The key index hashes a child by its parent and its value.
+constexpr std::uint64_t key_hash(std::uint64_t parent, std::uint64_t value_hash) noexcept {
+  return detail::mix(value_hash ^ ((parent + 1) * detail::hash_k0));
+}
+
+// The key hash `h` of a child whose parent moved from index `from` to `to`.
+// key_hash can be undone, so this needs neither the child's value nor its
+// hash.
+constexpr std::uint64_t rekey_hash(std::uint64_t h, std::uint64_t from,
+                                   std::uint64_t to) noexcept {
+  return detail::mix(detail::unmix(h) ^ ((from + 1) * detail::hash_k0) ^
+                     ((to + 1) * detail::hash_k0));
+}
+
+// Subtree hashes (document::subtree_hash) start from the hash of a token's
+// decoded value, take in the hash of each child in order along with where it
+// sits in the subtree, and finish with the size of the subtree. The state is
+// multiplied through before each child is added, and the child is mixed with
+// its position first, so no child can cancel what came before it and
+// reordering children changes the result.
+constexpr std::uint64_t subtree_seed(std::string_view value) noexcept {
+  return hash_bytes(value, detail::hash_k2);
+}
+// `at` is the child's index minus its parent's.
+constexpr std::uint64_t subtree_combine(std::uint64_t h, std::uint64_t child,
+                                        std::uint64_t at) noexcept {
+  return detail::mix(h * detail::hash_k0 + (child + at) * detail::hash_k2);
+}
+// `size` is the number of nodes in the subtree, the node included.
+constexpr std::uint64_t subtree_finish(std::uint64_t h, std::uint64_t size) noexcept {
+  return detail::mix(h * detail::hash_k1 + size);
+}
+
+} // namespace papr
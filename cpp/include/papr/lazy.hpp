@@ -0,0 +1,367 @@
+// papr - lazy.hpp
+// On-demand navigation that tokenizes only the parts of the input visited.
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "escape.hpp"
+#include "path.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+namespace detail {
+
+// Records the offset of every `:` `,` `;` outside quotes and comments, and
+// checks what can be checked from those alone: quotes and comments are
+// terminated, depth never drops below zero and never passes `max_depth`.
+// Whole blocks are taken from the scanner's delimiter masks.
+inline status index_structure(std::string_view input, const scanner& scan,
+                              std::uint32_t max_depth, std::pmr::vector<std::uint64_t>& out) {
+  const char* const data = input.data();
+  const char* const end = data + input.size();
+  std::uint32_t depth = 0;
+  // Applies the delimiter at `at`; a failed status when it breaks a rule.
+  const auto delimiter = [&](std::size_t at) -> status {
+    switch (data[at]) {
+      case ':':
+        if (depth == max_depth) return {error_code::depth_limit, at};
+        ++depth;
+        break;
+      case ';':
+        if (depth == 0) return {error_code::depth_underflow, at};
+        --depth;
+        break;
+      default: break;
+    }
+    out.push_back(at);
+    return {};
+  };
+
+  std::size_t pos = 0;
+  while (pos < input.size()) {
+    if (input.size() - pos >= block_size) {
+      const block_masks m = scan.classify(data + pos);
+      const std::uint64_t special = m.hash | m.quote;
+      std::uint64_t d = m.delimiter & (special ? (special & (0 - special)) - 1 : ~std::uint64_t{0});
+      for (; d != 0; d &= d - 1)
+        if (status st = delimiter(pos + static_cast<std::size_t>(std::countr_zero(d))); !st.ok())
+          return st;
+      if (special == 0) {
+        pos += block_size;
+        continue;
+      }
+      pos += static_cast<std::size_t>(std::countr_zero(special));
+    } else {
+      const char* p = scan.find_structural(data + pos, end);
+      if (p == end) break;
+      pos = static_cast<std::size_t>(p - data);
+      if (*p != '#' && *p != '"') {
+        if (status st = delimiter(pos++); !st.ok()) return st;
+        continue;
+      }
+    }
+
+    if (data[pos] == '#') {
+      if (pos + 1 < input.size() && data[pos + 1] == '#') {
+        const std::size_t close = input.find("##", pos + 2);
+        if (close == std::string_view::npos) return {error_code::unterminated_comment, pos};
+        pos = close + 2;
+      } else {
+        const void* eol = std::memchr(data + pos, '\n', input.size() - pos);
+        pos = eol == nullptr ? input.size()
+                             : static_cast<std::size_t>(static_cast<const char*>(eol) - data) + 1;
+      }
+      continue;
+    }
+    const char* p = data + pos + 1;
+    for (;;) {
+      p = scan.find_quote_end(p, end);
+      if (p == end || (*p == '\\' && end - p < 2)) return {error_code::unterminated_quote, pos};
+      if (*p == '"') break;
+      p += 2;
+    }
+    pos = static_cast<std::size_t>(p - data) + 1;
+  }
+  return {};
+}
+
+} // namespace detail
+
+class lazy_document;
+
+// A handle to one token of a lazy_document, or to its root. It is a slot
+// number: the token, if there is one, between two consecutive delimiters of
+// the structural index. Its text is tokenized each time it is asked for,
+// which costs a few bytes of scanning.
+class lazy_element {
+public:
+  class iterator;
+  struct range;
+
+  lazy_element() = default;
+
+  constexpr bool valid() const noexcept { return doc_ != nullptr; }
+  constexpr explicit operator bool() const noexcept { return valid(); }
+  constexpr bool is_root() const noexcept { return slot_ == root_slot; }
+
+  // As element::raw and element::value.
+  std::string_view raw() const noexcept;
+  std::string_view value(std::string& scratch) const;
+  bool is_quoted() const noexcept;
+
+  bool has_children() const noexcept { return static_cast<bool>(first_child()); }
+  lazy_element first_child() const noexcept;
+  // The first call for a token walks its subtree; later ones are a lookup.
+  lazy_element next_sibling() const;
+  range children() const noexcept;
+
+  // The first child whose value equals `key`, found by walking the children.
+  lazy_element find(std::string_view key) const;
+  lazy_element operator[](std::string_view key) const { return find(key); }
+
+  template <fixed_string... Keys>
+  lazy_element get() const {
+    lazy_element e = *this;
+    ((e = e.find(Keys.view())), ...);
+    return e;
+  }
+
+  static constexpr std::size_t root_slot = static_cast<std::size_t>(-1);
+
+private:
+  friend class lazy_document;
+  constexpr lazy_element(const lazy_document* doc, std::size_t slot) noexcept
+      : doc_(doc), slot_(slot) {}
+
+  const lazy_document* doc_ = nullptr;
+  std::size_t slot_ = 0;
+};
+
+class lazy_element::iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = lazy_element;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = lazy_element;
+
+  iterator() = default;
+  explicit iterator(lazy_element e) noexcept : e_(e) {}
+
+  lazy_element operator*() const noexcept { return e_; }
+  iterator& operator++() {
+    e_ = e_.next_sibling();
+    return *this;
+  }
+  iterator operator++(int) {
+    iterator old = *this;
+    ++*this;
+    return old;
+  }
+  friend bool operator==(const iterator& a, const iterator& b) noexcept { return a.same(b); }
+
+private:
+  // Every iterator past the last sibling is the same end iterator.
+  bool same(const iterator& other) const noexcept {
+    return e_.doc_ == other.e_.doc_ && (e_.doc_ == nullptr || e_.slot_ == other.e_.slot_);
+  }
+
+  lazy_element e_;
+};
+
+struct lazy_element::range {
+  iterator first, last;
+  iterator begin() const noexcept { return first; }
+  iterator end() const noexcept { return last; }
+  bool empty() const noexcept { return first == last; }
+};
+
+// A papr document navigated on demand, in the manner of simdjson's On-Demand
+// API. open() only records where the delimiters are, eight bytes per
+// delimiter; tokens are found and checked when an element reaches them, and
+// the next-sibling step of each token is worked out once and remembered.
+// Reading 1% of a large file costs about one scan of it.
+//
+// open() reports unterminated quotes and comments and depth errors. Errors
+// in the tokens themselves, like two tokens without a delimiter between
+// them, are only found in tokens that navigation reaches: the element asked
+// for is then invalid and error() says why. Navigation fills caches
+// inside the document, so one lazy_document must not be navigated from
+// several threads at once.
+class lazy_document {
+public:
+  lazy_document() noexcept : lazy_document(std::pmr::get_default_resource()) {}
+  explicit lazy_document(std::pmr::memory_resource* resource) noexcept
+      : structure_(resource), next_(resource) {}
+
+  lazy_document(const lazy_document&) = delete;
+  lazy_document& operator=(const lazy_document&) = delete;
+
+  // Indexes `input`, which has to outlive the document and its elements.
+  status open(std::string_view input, backend scan = backend::automatic,
+              std::uint32_t max_depth = default_max_depth) {
+    PAPR_TRACE_SCOPE("papr::lazy_open");
+    PAPR_STAT_ADD(bytes_scanned, input.size());
+    clear();
+    scanner_ = &get_scanner(scan);
+    const status st = detail::index_structure(input, *scanner_, max_depth, structure_);
+    if (!st.ok()) {
+      clear();
+      return st;
+    }
+    source_ = input;
+    return {};
+  }
+
+  void clear() noexcept {
+    source_ = {};
+    structure_.clear();
+    next_.clear();
+    error_ = {};
+  }
+
+  lazy_element root() const noexcept { return {this, lazy_element::root_slot}; }
+
+  template <fixed_string... Keys>
+  lazy_element get() const {
+    return root().get<Keys...>();
+  }
+
+  std::string_view source() const noexcept { return source_; }
+  // Offsets of the delimiters, in order.
+  std::span<const std::uint64_t> structure() const noexcept { return structure_; }
+  // The first error navigation ran into, or success.
+  status error() const noexcept { return error_; }
+
+private:
+  friend class lazy_element;
+
+  static constexpr std::size_t no_slot = static_cast<std::size_t>(-1);
+
+  std::size_t slot_count() const noexcept { return structure_.size() + 1; }
+
+  // The token of `slot`, or false when the slot is empty or malformed.
+  bool token_at(std::size_t slot, token& out) const noexcept {
+    const std::size_t begin = slot == 0 ? 0 : static_cast<std::size_t>(structure_[slot - 1]) + 1;
+    const std::size_t end =
+        slot < structure_.size() ? static_cast<std::size_t>(structure_[slot]) : source_.size();
+    tokenizer tok{source_.substr(begin, end - begin), scanner_->kind};
+    const token t = tok.next();
+    if (t.kind == token_kind::end) return false;
+    // The slot holds no delimiter, so anything but one token and the end is
+    // an error the tokenizer has reported.
+    if (t.kind != token_kind::text || tok.next().kind != token_kind::end) {
+      note({tok.error(), begin + tok.error_offset()});
+      return false;
+    }
+    out = t;
+    return true;
+  }
+
+  bool has_token(std::size_t slot) const noexcept {
+    token t;
+    return token_at(slot, t);
+  }
+
+  // The slot after a token's trailing `:`, where its first child is.
+  std::size_t first_child(std::size_t slot) const noexcept {
+    const std::size_t at = slot == lazy_element::root_slot ? 0 : slot + 1;
+    if (slot != lazy_element::root_slot &&
+        (slot >= structure_.size() || source_[structure_[slot]] != ':'))
+      return no_slot;
+    return at < slot_count() && has_token(at) ? at : no_slot;
+  }
+
+  // Walks the delimiters after a token, tracking depth relative to it, to
+  // the next token at the same depth.
+  std::size_t next_sibling(std::size_t slot) const {
+    if (const auto it = next_.find(slot); it != next_.end()) return it->second;
+    std::size_t found = no_slot;
+    std::int64_t depth = 0;
+    for (std::size_t j = slot; j < structure_.size(); ++j) {
+      const char d = source_[structure_[j]];
+      depth += d == ':' ? 1 : d == ';' ? -1 : 0;
+      if (depth < 0) break;
+      if (depth == 0 && has_token(j + 1)) {
+        found = j + 1;
+        break;
+      }
+    }
+    next_.emplace(slot, found);
+    return found;
+  }
+
+  void note(status st) const noexcept {
+    if (error_.ok()) error_ = st;
+  }
+
+  std::string_view source_;
+  const scanner* scanner_ = &get_scanner(backend::automatic);
+  std::pmr::vector<std::uint64_t> structure_;
+  // next_sibling of every slot it was asked for.
+  mutable std::pmr::unordered_map<std::size_t, std::size_t> next_;
+  mutable status error_;
+};
+
+inline std::string_view lazy_element::raw() const noexcept {
+  token t;
+  if (!valid() || is_root() || !doc_->token_at(slot_, t)) return {};
+  return t.text;
+}
+
+inline std::string_view lazy_element::value(std::string& scratch) const {
+  token t;
+  if (!valid() || is_root() || !doc_->token_at(slot_, t)) return {};
+  if (!t.has_escapes()) return t.text;
+  scratch.resize(t.text.size());
+  scratch.resize(unescape(t.text, scratch.data()));
+  return scratch;
+}
+
+inline bool lazy_element::is_quoted() const noexcept {
+  token t;
+  return valid() && !is_root() && doc_->token_at(slot_, t) && t.is_quoted();
+}
+
+inline lazy_element lazy_element::first_child() const noexcept {
+  if (!valid()) return {};
+  const std::size_t c = doc_->first_child(slot_);
+  if (c == lazy_document::no_slot) return {};
+  return {doc_, c};
+}
+
+inline lazy_element lazy_element::next_sibling() const {
+  if (!valid() || is_root()) return {};
+  const std::size_t s = doc_->next_sibling(slot_);
+  if (s == lazy_document::no_slot) return {};
+  return {doc_, s};
+}
+
+inline lazy_element::range lazy_element::children() const noexcept {
+  return {iterator{first_child()}, iterator{}};
+}
+
+inline lazy_element lazy_element::find(std::string_view key) const {
+  for (lazy_element c = first_child(); c; c = c.next_sibling()) {
+    token t;
+    if (!doc_->token_at(c.slot_, t)) continue;
+    if (t.has_escapes() ? unescaped_equals(t.text, key) : t.text == key) return c;
+  }
+  return {};
+}
+
+} // namespace papr
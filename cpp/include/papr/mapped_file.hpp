@@ -0,0 +1,158 @@
+// papr - mapped_file.hpp
+// Read-only memory mapping of .papr files and in-place parsing over them.
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "document.hpp"
+#include "error.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+
+namespace papr {
+
+// A read-only, private mapping of a whole file. The pages come straight from
+// the page cache, so processes that map the same file share its memory, and
+// nothing is read() or copied up front.
+class mapped_file {
+public:
+  mapped_file() = default;
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+  mapped_file(mapped_file&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  mapped_file& operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+      close();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+  ~mapped_file() { close(); }
+
+  // Maps `path`, replacing any previous mapping. An empty file maps to an
+  // empty view.
+  status open(const char* path) noexcept;
+  void close() noexcept;
+
+  std::string_view data() const noexcept { return {data_, size_}; }
+  std::size_t size() const noexcept { return size_; }
+  bool is_open() const noexcept { return data_ != nullptr || size_ != 0; }
+
+private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+#if defined(_WIN32)
+
+inline status mapped_file::open(const char* path) noexcept {
+  close();
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return {error_code::io_error, 0};
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return {error_code::io_error, 0};
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    return {};
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) return {error_code::io_error, 0};
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (view == nullptr) return {error_code::io_error, 0};
+  data_ = static_cast<const char*>(view);
+  size_ = static_cast<std::size_t>(size.QuadPart);
+  return {};
+}
+
+inline void mapped_file::close() noexcept {
+  if (data_ != nullptr) UnmapViewOfFile(data_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#else
+
+inline status mapped_file::open(const char* path) noexcept {
+  close();
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return {error_code::io_error, 0};
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return {error_code::io_error, 0};
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return {};
+  }
+  void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) return {error_code::io_error, 0};
+  // The parser reads the mapping front to back exactly once.
+  ::madvise(addr, size, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(addr);
+  size_ = size;
+  return {};
+}
+
+inline void mapped_file::close() noexcept {
+  if (data_ != nullptr) ::munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
+
+// A document parsed in place over a mapped file. Node text views the mapped
+// pages directly; only escaped quoted tokens are ever materialized, and only
+// when they are read. The mapping lives exactly as long as the document.
+class mapped_document {
+public:
+  explicit mapped_document(std::pmr::memory_resource* resource =
+                               std::pmr::get_default_resource()) noexcept
+      : doc_(resource) {}
+
+  // Maps `path` and parses it, replacing whatever was loaded before.
+  status open(const char* path, backend scan = backend::automatic) {
+    doc_.clear();
+    if (status st = file_.open(path); !st.ok()) return st;
+    return parse(file_.data(), doc_, scan);
+  }
+
+  const document& doc() const noexcept { return doc_; }
+  const mapped_file& file() const noexcept { return file_; }
+
+private:
+  mapped_file file_;
+  document doc_;
+};
+
+} // namespace papr
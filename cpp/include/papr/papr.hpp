@@ -0,0 +1,32 @@
+// papr - papr.hpp
+// Convenience header that pulls in the whole C++ parser.
+#pragma once
+
+#include "arena.hpp"
+#include "batch.hpp"
+#include "binary.hpp"
+#include "cache.hpp"
+#include "compact.hpp"
+#include "convert.hpp"
+#include "diff.hpp"
+#include "document.hpp"
+#include "encoder.hpp"
+#include "epoch.hpp"
+#include "error.hpp"
+#include "escape.hpp"
+#include "hash.hpp"
+#include "lazy.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "path.hpp"
+#include "pretty.hpp"
+#include "projection.hpp"
+#include "sax.hpp"
+#include "scanner.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "symbols.hpp"
+#include "tokenizer.hpp"
+#include "validate.hpp"
+#include "writer.hpp"
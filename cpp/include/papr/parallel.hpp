@@ -0,0 +1,345 @@
+// papr - parallel.hpp
+// Multi-threaded parsing of large documents.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory_resource>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.hpp"
+#include "error.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+namespace detail {
+
+// The lexical state at a byte boundary. Depth is a prefix sum over `:` and
+// `;`, but only outside quotes and comments, so before a chunk can be parsed
+// on its own we need to know which of these states it starts in.
+enum lex_state : std::uint8_t {
+  lex_normal,
+  lex_normal_hash, // just after a `#`: the next byte picks `#` or `##`
+  lex_quote,
+  lex_quote_escape, // just after a `\` inside quotes
+  lex_line,
+  lex_block,
+  lex_block_hash, // just after a `#` inside a `##` comment
+  lex_state_count,
+};
+
+enum lex_class : std::uint8_t {
+  lex_other,
+  lex_quote_char,
+  lex_backslash,
+  lex_hash_char,
+  lex_newline,
+  lex_delimiter,
+  lex_class_count,
+};
+
+inline constexpr auto lex_classes = [] {
+  std::array<std::uint8_t, 256> table{};
+  table[static_cast<unsigned char>('"')] = lex_quote_char;
+  table[static_cast<unsigned char>('\\')] = lex_backslash;
+  table[static_cast<unsigned char>('#')] = lex_hash_char;
+  table[static_cast<unsigned char>('\n')] = lex_newline;
+  table[static_cast<unsigned char>(':')] = lex_delimiter;
+  table[static_cast<unsigned char>(',')] = lex_delimiter;
+  table[static_cast<unsigned char>(';')] = lex_delimiter;
+  return table;
+}();
+
+// transitions[state][class], mirroring what the tokenizer does byte by byte.
+inline constexpr std::uint8_t lex_transitions[lex_state_count][lex_class_count] = {
+    //          other        "                \                 #                \n           :,;
+    /* N  */ {lex_normal, lex_quote, lex_normal, lex_normal_hash, lex_normal, lex_normal},
+    /* NH */ {lex_line, lex_line, lex_line, lex_block, lex_normal, lex_line},
+    /* Q  */ {lex_quote, lex_normal, lex_quote_escape, lex_quote, lex_quote, lex_quote},
+    /* QE */ {lex_quote, lex_quote, lex_quote, lex_quote, lex_quote, lex_quote},
+    /* L  */ {lex_line, lex_line, lex_line, lex_line, lex_normal, lex_line},
+    /* B  */ {lex_block, lex_block, lex_block, lex_block_hash, lex_block, lex_block},
+    /* BH */ {lex_block, lex_block, lex_block, lex_normal, lex_block, lex_block},
+};
+
+constexpr bool lex_is_pending(std::uint8_t s) noexcept {
+  return s == lex_normal_hash || s == lex_quote_escape || s == lex_block_hash;
+}
+
+// What a chunk does to each possible entry state: the state it leaves the
+// lexer in, and where the first delimiter outside quotes and comments is.
+struct chunk_transfer {
+  std::array<std::uint8_t, lex_state_count> exit{};
+  std::array<std::size_t, lex_state_count> first_delimiter{};
+};
+
+// Runs all entry states through the chunk at once. Only the six bytes the
+// lexer cares about change a state, except right after a `#` or `\`, where
+// the next byte is looked at whatever it is.
+inline chunk_transfer lex_chunk(std::string_view chunk) noexcept {
+  constexpr std::size_t none = static_cast<std::size_t>(-1);
+  std::array<std::uint8_t, lex_state_count> states;
+  std::array<std::size_t, lex_state_count> first;
+  for (std::uint8_t s = 0; s < lex_state_count; ++s) {
+    states[s] = s;
+    first[s] = none;
+  }
+  // Some entry states are themselves waiting on the first byte.
+  bool pending = true;
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    const std::uint8_t cls = lex_classes[static_cast<unsigned char>(chunk[i])];
+    if (cls == lex_other && !pending) continue;
+    pending = false;
+    for (std::uint8_t s = 0; s < lex_state_count; ++s) {
+      if (cls == lex_delimiter && states[s] == lex_normal && first[s] == none)
+        first[s] = i;
+      states[s] = lex_transitions[states[s]][cls];
+      pending |= lex_is_pending(states[s]);
+    }
+  }
+  return {states, first};
+}
+
+// The tape of one segment, built as if the segment were a document on its own
+// but with depths relative to the segment start. Those can go negative, so
+// they are stored biased by relative_bias until the base depth is known.
+struct segment_tape {
+  static constexpr std::uint32_t relative_bias = 0x80000000u;
+
+  struct boundary {
+    std::uint64_t index; // local node index
+    std::uint32_t depth; // biased relative depth
+  };
+
+  std::vector<node> nodes;
+  // Nodes that reach a new minimum depth; each closes whatever open subtrees
+  // of earlier segments are at least as deep.
+  std::vector<boundary> closers;
+  // Nodes whose subtrees are still open at the end of the segment, shallowest
+  // first.
+  std::vector<std::uint64_t> open;
+  // underflow_at[k] is the offset of the `;` that first took the relative
+  // depth from -k to -k-1.
+  std::vector<std::size_t> underflow_at;
+  // overflow_at[k] is the offset of the `:` that first took it from k to k+1.
+  std::vector<std::size_t> overflow_at;
+  std::int64_t delta = 0;
+  status error;
+};
+
+inline void build_segment(std::string_view input, std::size_t begin,
+                          std::size_t end, backend scan, segment_tape& out) {
+  constexpr std::uint32_t bias = segment_tape::relative_bias;
+  const std::string_view text = input.substr(begin, end - begin);
+  std::vector<node>& nodes = out.nodes;
+  tokenizer tok{text, scan};
+  nodes.reserve(max_node_count(text, get_scanner(tok.scanner_backend())));
+
+  std::uint64_t open = no_node;
+  std::uint32_t depth = bias;
+  std::uint32_t lowest = ~std::uint32_t{0};
+  const auto close_to = [&](std::uint32_t d, std::uint64_t next) noexcept {
+    while (open != no_node && nodes[open].depth >= d) {
+      const std::uint64_t parent = nodes[open].next;
+      nodes[open].next = next;
+      open = parent;
+    }
+  };
+
+  for (token t = tok.next();; t = tok.next()) {
+    switch (t.kind) {
+      case token_kind::text: {
+        const std::uint64_t index = nodes.size();
+        close_to(depth, index);
+        if (depth < lowest) {
+          out.closers.push_back({index, depth});
+          lowest = depth;
+        }
+        nodes.push_back({begin + tok.offset_of(t), t.text.size(), open, depth, t.flags});
+        open = index;
+        break;
+      }
+      case token_kind::colon:
+        if (static_cast<std::int64_t>(depth) - bias ==
+            static_cast<std::int64_t>(out.overflow_at.size()))
+          out.overflow_at.push_back(begin + tok.position() - 1);
+        ++depth;
+        break;
+      case token_kind::comma: break;
+      case token_kind::semicolon:
+        if (static_cast<std::int64_t>(depth) - bias ==
+            -static_cast<std::int64_t>(out.underflow_at.size()))
+          out.underflow_at.push_back(begin + tok.position() - 1);
+        --depth;
+        break;
+      case token_kind::end:
+        for (; open != no_node; open = nodes[open].next) out.open.push_back(open);
+        std::reverse(out.open.begin(), out.open.end());
+        out.delta = static_cast<std::int64_t>(depth) - bias;
+        return;
+      case token_kind::error:
+        out.error = {tok.error(), begin + tok.error_offset()};
+        return;
+    }
+  }
+}
+
+// Runs fn(0) .. fn(count - 1) on their own threads and rethrows the first
+// exception any of them raised. With PAPR_ENABLE_STATS, what the workers
+// counted is added to the calling thread's counters.
+template <class Fn>
+void run_parallel(std::size_t count, Fn fn) {
+  std::vector<std::exception_ptr> errors(count);
+#if defined(PAPR_ENABLE_STATS)
+  std::vector<parse_stats> counted(count);
+#endif
+  std::vector<std::thread> threads;
+  threads.reserve(count);
+  for (std::size_t i = 0; i < count; ++i)
+    threads.emplace_back([&, i] {
+      try {
+        fn(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+#if defined(PAPR_ENABLE_STATS)
+      counted[i] = thread_stats();
+#endif
+    });
+  for (std::thread& t : threads) t.join();
+#if defined(PAPR_ENABLE_STATS)
+  for (const parse_stats& s : counted) thread_stats() += s;
+#endif
+  for (const std::exception_ptr& e : errors)
+    if (e) std::rethrow_exception(e);
+}
+
+} // namespace detail
+
+struct parallel_options {
+  // Worker threads; 0 means std::thread::hardware_concurrency().
+  unsigned threads = 0;
+  // Inputs are never split into chunks smaller than this.
+  std::size_t min_chunk_size = std::size_t{1} << 20;
+  backend scan = backend::automatic;
+  // The deepest nesting accepted; see papr::parse.
+  std::uint32_t max_depth = default_max_depth;
+};
+
+// Parses `input` into `doc` on several threads and produces exactly the tape
+// papr::parse would. It works in five steps:
+//
+//  1. Each thread lexes one chunk from every possible entry state at once,
+//     tracking only quotes, comments and delimiters.
+//  2. Chaining those results from the start of the input gives the true
+//     state at every chunk boundary. Each boundary is then moved just past
+//     the next delimiter outside quotes and comments, and a chunk without one
+//     is merged into its predecessor.
+//  3. Each thread tokenizes one segment into its own tape with depths
+//     relative to the segment start.
+//  4. A prefix sum over the segments' depth deltas gives their base depths.
+//  5. The segment tapes are copied into the document in parallel, and the
+//     subtrees left open at segment ends are closed in one short serial pass.
+inline status parse_parallel(std::string_view input, document& doc,
+                             const parallel_options& options = {}) {
+  PAPR_TRACE_SCOPE("papr::parse_parallel");
+  unsigned threads = options.threads ? options.threads
+                                     : std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t min_chunk = std::max<std::size_t>(options.min_chunk_size, 1);
+  const std::size_t chunks =
+      std::min<std::size_t>(threads, std::max<std::size_t>(1, input.size() / min_chunk));
+  if (chunks <= 1) return parse(input, doc, options.scan, options.max_depth);
+
+  // Steps 1 and 2.
+  const auto chunk_begin = [&](std::size_t c) { return input.size() / chunks * c; };
+  std::vector<detail::chunk_transfer> transfers(chunks);
+  detail::run_parallel(chunks, [&](std::size_t c) {
+    const std::size_t end = c + 1 == chunks ? input.size() : chunk_begin(c + 1);
+    transfers[c] = detail::lex_chunk(input.substr(chunk_begin(c), end - chunk_begin(c)));
+  });
+  std::vector<std::size_t> cuts{0};
+  std::uint8_t state = detail::lex_normal;
+  for (std::size_t c = 0; c < chunks; ++c) {
+    const std::size_t first = transfers[c].first_delimiter[state];
+    if (c > 0 && first != static_cast<std::size_t>(-1))
+      cuts.push_back(chunk_begin(c) + first + 1);
+    state = transfers[c].exit[state];
+  }
+  cuts.push_back(input.size());
+
+  // Step 3.
+  const std::size_t segments = cuts.size() - 1;
+  std::vector<detail::segment_tape> tapes(segments);
+  detail::run_parallel(segments, [&](std::size_t s) {
+    detail::build_segment(input, cuts[s], cuts[s + 1], options.scan, tapes[s]);
+  });
+
+  // Step 4. The first segment to fail, by underflow, by nesting too deep or
+  // by a lexical error, holds the error papr::parse would have reported.
+  doc.clear();
+  std::vector<std::uint64_t> base(segments), first_index(segments);
+  std::int64_t depth = 0;
+  std::uint64_t total = 0;
+  for (std::size_t s = 0; s < segments; ++s) {
+    const detail::segment_tape& tape = tapes[s];
+    status err = tape.error;
+    if (static_cast<std::size_t>(depth) < tape.underflow_at.size()) {
+      const std::size_t at = tape.underflow_at[static_cast<std::size_t>(depth)];
+      if (err.ok() || at < err.offset) err = {error_code::depth_underflow, at};
+    }
+    const std::uint64_t room = options.max_depth - static_cast<std::uint64_t>(depth);
+    if (room < tape.overflow_at.size()) {
+      const std::size_t at = tape.overflow_at[static_cast<std::size_t>(room)];
+      if (err.ok() || at < err.offset) err = {error_code::depth_limit, at};
+    }
+    if (!err.ok()) return err;
+    base[s] = static_cast<std::uint64_t>(depth);
+    first_index[s] = total;
+    depth += tape.delta;
+    total += tape.nodes.size();
+  }
+
+  // Step 5.
+  std::pmr::vector<node>& nodes = detail::document_access::nodes(doc);
+  nodes.resize(total);
+  detail::run_parallel(segments, [&](std::size_t s) {
+    const detail::segment_tape& tape = tapes[s];
+    const std::uint64_t shift = first_index[s];
+    const auto rebase = static_cast<std::uint32_t>(base[s]);
+    node* out = nodes.data() + shift;
+    for (const node& n : tape.nodes) {
+      *out = n;
+      out->depth = n.depth - detail::segment_tape::relative_bias + rebase;
+      out->next += shift;
+      PAPR_STAT_MAX(max_depth, out->depth);
+      ++out;
+    }
+  });
+  std::vector<std::uint64_t> open;
+  for (std::size_t s = 0; s < segments; ++s) {
+    const detail::segment_tape& tape = tapes[s];
+    const auto rebase = static_cast<std::uint32_t>(base[s]);
+    for (const auto& closer : tape.closers) {
+      const std::uint32_t d = closer.depth - detail::segment_tape::relative_bias + rebase;
+      while (!open.empty() && nodes[open.back()].depth >= d) {
+        nodes[open.back()].next = first_index[s] + closer.index;
+        open.pop_back();
+      }
+    }
+    for (std::uint64_t i : tape.open) open.push_back(first_index[s] + i);
+  }
+  for (std::uint64_t i : open) nodes[i].next = total;
+  detail::document_access::set_source(doc, input);
+  return {};
+}
+
+} // namespace papr
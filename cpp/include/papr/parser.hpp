@@ -0,0 +1,645 @@
+// papr - parser.hpp
+// Builds a document tape from papr text.
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "document.hpp"
+#include "error.hpp"
+#include "escape.hpp"
+#include "hash.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+namespace detail {
+
+struct document_access {
+  template <class Node>
+  static std::pmr::vector<Node>& nodes(basic_document<Node>& doc) noexcept {
+    return doc.nodes_;
+  }
+  // The side table comments are recorded into while parsing.
+  template <class Node>
+  static std::pmr::vector<comment_range>& keep_comments(basic_document<Node>& doc) noexcept {
+    doc.keeps_comments_ = true;
+    return doc.comments_;
+  }
+  // Where subtree hashes go while parsing.
+  template <class Node>
+  static std::pmr::vector<std::uint64_t>& keep_hashes(basic_document<Node>& doc) noexcept {
+    doc.hashed_ = true;
+    return doc.hashes_;
+  }
+  // Called once the tape is complete; the document reads through it from
+  // then on.
+  template <class Node>
+  static void set_source(basic_document<Node>& doc, std::string_view source) noexcept {
+    doc.source_ = source;
+    doc.tape_ = doc.nodes_;
+    doc.table_ = doc.index_;
+  }
+  // Makes `doc` read memory it does not own, e.g. a loaded .paprb image.
+  static void adopt(document& doc, std::string_view source, std::span<const node> tape,
+                    std::span<const index_slot> table) noexcept {
+    doc.clear();
+    doc.source_ = source;
+    doc.tape_ = tape;
+    doc.table_ = table;
+  }
+  static std::span<const index_slot> table(const document& doc) noexcept {
+    return doc.table_;
+  }
+  static void release_decoded(document& doc) noexcept { doc.release_decoded(); }
+  static void insert_key(document& doc, std::size_t i, std::size_t parent,
+                         std::string_view key, std::uint64_t h) noexcept {
+    doc.insert_key(i, parent, key, h);
+  }
+  static bool erase_key(document& doc, std::size_t i, std::uint64_t h) noexcept {
+    return doc.erase_key(i, h);
+  }
+  static std::pmr::vector<index_slot>& index(document& doc) noexcept { return doc.index_; }
+  static std::uint64_t key_id(const document& doc, std::size_t parent) noexcept {
+    return doc.key_id(parent);
+  }
+  static bool has_key_ids(const document& doc) noexcept { return !doc.key_ids_.empty(); }
+  // Key ids by node index, numbering each node by its index first if they
+  // were implicit until now.
+  static std::pmr::vector<std::uint64_t>& key_ids(document& doc) {
+    if (doc.key_ids_.empty()) {
+      doc.key_ids_.resize(doc.size());
+      for (std::size_t i = 0; i < doc.size(); ++i) doc.key_ids_[i] = i;
+      doc.next_key_id_ = doc.size();
+    }
+    return doc.key_ids_;
+  }
+  static std::uint64_t new_key_id(document& doc) noexcept { return doc.next_key_id_++; }
+  static std::pmr::vector<std::uint32_t>& symbols(document& doc) noexcept {
+    return doc.symbols_;
+  }
+  static void intern_nodes(document& doc, std::size_t begin, std::size_t end) {
+    doc.intern_nodes(begin, end);
+  }
+  static void rehash(document& doc, std::size_t i, std::string& scratch) {
+    doc.rehash(i, scratch);
+  }
+};
+
+inline constexpr std::uint64_t no_node = ~std::uint64_t{0};
+
+// Every token but the last is followed by a delimiter, so the number of `:`,
+// `,` and `;` bytes plus one bounds the node count. Counting them is a single
+// pass over the scanner's bitmasks and lets the tape be allocated exactly once.
+inline std::size_t max_node_count(std::string_view input,
+                                  const scanner& scan) noexcept {
+  const char* p = input.data();
+  const char* const end = p + input.size();
+  std::size_t count = 1;
+  for (; end - p >= static_cast<std::ptrdiff_t>(block_size); p += block_size)
+    count += static_cast<std::size_t>(std::popcount(scan.classify(p).delimiter));
+  for (; p < end; ++p) count += *p == ':' || *p == ',' || *p == ';';
+  return count;
+}
+
+// Builds the tape in one forward pass without recursion: the chain of nodes
+// whose subtrees are still open is threaded through their own `next` fields,
+// and each one is patched to its final value as soon as a token at the same or
+// a lower depth arrives. No stack is needed, so the only bound on nesting is
+// `max_depth`.
+//
+// With `hashes` set, subtree hashes are built along the way: a node's hash is
+// finished with its size when its subtree closes, and is then folded into
+// its parent's.
+//
+// A Node with links narrower than 64 bits (compact_node) takes inputs whose
+// size fits in them with a value to spare, so every offset, length and node
+// count fits too; larger inputs fail with input_too_large before anything is
+// read. Nesting is limited to Node::max_depth whatever `max_depth` says.
+template <class Node>
+status build(std::string_view input, basic_document<Node>& doc, backend scan,
+             std::uint32_t max_depth = default_max_depth, bool comments = false,
+             bool hashes = false) {
+  PAPR_TRACE_SCOPE("papr::parse");
+  using link = decltype(Node::next);
+  constexpr std::uint64_t none = link(~link{0}); // no_node in a link
+  doc.clear();
+  if constexpr (sizeof(link) < sizeof(std::size_t))
+    if (input.size() >= none) return {error_code::input_too_large, 0};
+  max_depth = std::min(max_depth, Node::max_depth);
+  std::pmr::vector<Node>& nodes = document_access::nodes(doc);
+  tokenizer tok{input, scan};
+  if (comments) tok.record_comments(&document_access::keep_comments(doc));
+  nodes.reserve(max_node_count(input, get_scanner(tok.scanner_backend())));
+  std::pmr::vector<std::uint64_t>* const hash =
+      hashes ? &document_access::keep_hashes(doc) : nullptr;
+  if (hashes) hash->reserve(nodes.capacity());
+  std::string scratch;
+
+  std::uint64_t open = none; // deepest node whose subtree is open
+  std::uint32_t depth = 0;
+  const auto close_to = [&](std::uint32_t d, std::uint64_t next) noexcept {
+    while (open != none && nodes[open].depth >= d) {
+      const std::uint64_t parent = nodes[open].next;
+      nodes[open].next = static_cast<link>(next);
+      if (hashes) {
+        (*hash)[open] = subtree_finish((*hash)[open], next - open);
+        if (parent != none)
+          (*hash)[parent] = subtree_combine((*hash)[parent], (*hash)[open], open - parent);
+      }
+      open = parent;
+    }
+  };
+
+  for (token t = tok.next();; t = tok.next()) {
+    switch (t.kind) {
+      case token_kind::text: {
+        const std::uint64_t index = nodes.size();
+        close_to(depth, index);
+        nodes.push_back({static_cast<link>(tok.offset_of(t)), static_cast<link>(t.text.size()),
+                         static_cast<link>(open), depth, t.flags});
+        PAPR_STAT_MAX(max_depth, depth);
+        open = index;
+        if (!hashes) break;
+        if (t.has_escapes()) {
+          scratch.resize(t.text.size());
+          scratch.resize(unescape(t.text, scratch.data()));
+          hash->push_back(subtree_seed(scratch));
+        } else {
+          hash->push_back(subtree_seed(t.text));
+        }
+        break;
+      }
+      case token_kind::colon:
+        if (depth == max_depth) {
+          doc.clear();
+          return {error_code::depth_limit, tok.position() - 1};
+        }
+        ++depth;
+        break;
+      case token_kind::comma: break;
+      case token_kind::semicolon:
+        if (depth == 0) {
+          doc.clear();
+          return {error_code::depth_underflow, tok.position() - 1};
+        }
+        --depth;
+        break;
+      case token_kind::end:
+        close_to(0, nodes.size());
+        document_access::set_source(doc, input);
+        return {};
+      case token_kind::error:
+        doc.clear();
+        return {tok.error(), tok.error_offset()};
+    }
+  }
+}
+
+} // namespace detail
+
+// Parses `input` into `doc`, replacing what it held. The document allocates
+// from its own memory resource. On failure the document is left empty and the
+// status holds the offset of the offending byte. A `:` that would nest deeper
+// than `max_depth` fails with depth_limit. A compact_document takes inputs
+// under 4 GiB; see detail::build.
+template <class Node>
+status parse(std::string_view input, basic_document<Node>& doc,
+             backend scan = backend::automatic,
+             std::uint32_t max_depth = default_max_depth) {
+  return detail::build(input, doc, scan, max_depth);
+}
+
+// One contiguous replacement in a document's source: `removed` bytes at
+// `offset` were replaced by `inserted` new ones.
+struct edit {
+  std::size_t offset = 0;
+  std::size_t removed = 0;
+  std::size_t inserted = 0;
+};
+
+namespace detail {
+
+// Where a node's token starts in the source, opening quote included.
+constexpr std::size_t token_begin(const node& n) noexcept {
+  return static_cast<std::size_t>(n.offset) - ((n.flags & node::quoted) ? 1 : 0);
+}
+
+// True when the text after the last delimiter of a window ends inside a `#`
+// comment, which would run on into the text that follows the window. The text
+// holds nothing but whitespace and comments, or the window would not have
+// ended on a delimiter; unterminated `##` comments were already rejected.
+inline bool ends_in_comment(std::string_view text) noexcept {
+  for (std::size_t i = 0; i < text.size();) {
+    if (text[i] != '#') {
+      ++i;
+    } else if (i + 1 < text.size() && text[i + 1] == '#') {
+      i = text.find("##", i + 2) + 2;
+    } else {
+      const std::size_t eol = text.find('\n', i + 1);
+      if (eol == std::string_view::npos) return true;
+      i = eol + 1;
+    }
+  }
+  return false;
+}
+
+// Lexes input[begin, end) into `out` as the tokens of a document that is at
+// `depth` just before `begin`. Returns false on any error. `settled` is set
+// when the window ends between a delimiter and the next token, the only place
+// where the rest of the input is guaranteed to lex the same as it did before.
+inline bool lex_window(std::string_view input, std::size_t begin, std::size_t end,
+                       std::uint32_t& depth, std::pmr::vector<node>& out,
+                       bool& settled, backend scan, std::uint32_t max_depth) {
+  out.clear();
+  tokenizer tok{input.substr(begin, end - begin), scan};
+  std::size_t tail = 0; // where the text after the last token starts
+  settled = true;
+  for (token t = tok.next();; t = tok.next()) {
+    switch (t.kind) {
+      case token_kind::text:
+        out.push_back({begin + tok.offset_of(t), t.text.size(), 0, depth, t.flags});
+        PAPR_STAT_MAX(max_depth, depth);
+        settled = false;
+        continue;
+      case token_kind::colon:
+        if (depth == max_depth) return false;
+        ++depth;
+        break;
+      case token_kind::comma: break;
+      case token_kind::semicolon:
+        if (depth == 0) return false;
+        --depth;
+        break;
+      case token_kind::end:
+        settled = settled && !ends_in_comment(tok.input().substr(tail));
+        return true;
+      case token_kind::error: return false;
+    }
+    settled = true;
+    tail = tok.position();
+  }
+}
+
+} // namespace detail
+
+// Brings `doc` up to date with `input`, its source after `change`, by
+// re-lexing only the part of the text the edit can have affected and splicing
+// the result into the tape. The document's current source must still be
+// readable during the call; the document views `input` afterwards.
+//
+// The window starts at the last token beginning at or before the edit, since
+// a token always starts in the state the tokenizer starts in. It ends just
+// before the first token after the edit, widened token by token until it ends
+// on a delimiter and outside any comment, at the depth the old tape had
+// there. Everything after it then lexes exactly as before and only has its
+// offsets and indices shifted. When no such end is found (a quote or `##`
+// comment crossing the edit, a change in depth) this falls back to a full
+// parse, which also produces the right error for invalid input.
+//
+// An existing key index is kept: when the edit leaves the shape of the tape
+// alone, only the keys that changed are updated; otherwise the window's keys
+// are filed again and the rest are renumbered. An interned document interns
+// the window's values into the symbols it has, where the values the edit
+// removed stay behind.
+inline status reparse(document& doc, std::string_view input, const edit& change,
+                      backend scan = backend::automatic,
+                      std::uint32_t max_depth = default_max_depth) {
+  PAPR_TRACE_SCOPE("papr::reparse");
+  using detail::document_access;
+  std::pmr::vector<node>& nodes = document_access::nodes(doc);
+  const std::string_view old = doc.source();
+  const bool indexed = doc.has_index();
+  const bool interned = doc.is_interned();
+  const bool comments = doc.keeps_comments();
+  const bool hashed = doc.has_subtree_hashes();
+  const auto full = [&] {
+    const status st = detail::build(input, doc, scan, max_depth, comments, hashed);
+    if (st.ok() && indexed) doc.build_index();
+    if (st.ok() && interned) doc.intern();
+    return st;
+  };
+  // The comment table is not patched; a document that keeps one is parsed
+  // again.
+  if (comments || nodes.empty() || change.offset > old.size() ||
+      change.removed > old.size() - change.offset ||
+      input.size() != old.size() - change.removed + change.inserted)
+    return full();
+
+  const auto starts_by = [](std::size_t at) {
+    return [at](const node& n) { return detail::token_begin(n) <= at; };
+  };
+  const std::size_t before =
+      static_cast<std::size_t>(std::partition_point(nodes.begin(), nodes.end(),
+                                                    starts_by(change.offset)) -
+                               nodes.begin());
+  const std::size_t first = before == 0 ? 0 : before - 1;
+  const std::size_t begin = before == 0 ? 0 : detail::token_begin(nodes[first]);
+  const std::uint32_t start_depth = before == 0 ? 0 : nodes[first].depth;
+  std::size_t last = static_cast<std::size_t>(
+      std::partition_point(nodes.begin() + first, nodes.end(),
+                           starts_by(change.offset + change.removed)) -
+      nodes.begin());
+
+  constexpr int max_widenings = 8;
+  std::pmr::vector<node> window(doc.resource());
+  for (int widened = 0;; ++widened, ++last) {
+    if (widened > max_widenings) return full();
+    const std::size_t end = last == nodes.size()
+                                ? input.size()
+                                : detail::token_begin(nodes[last]) + change.inserted -
+                                      change.removed;
+    std::uint32_t depth = start_depth;
+    bool settled = false;
+    if (!detail::lex_window(input, begin, end, depth, window, settled, scan, max_depth))
+      return full();
+    if (last == nodes.size()) break;
+    if (!settled) continue;
+    if (depth != nodes[last].depth) return full();
+    break;
+  }
+
+  const std::size_t added = window.size();
+  const std::size_t replaced = last - first;
+  const std::size_t shift = added - replaced; // wraps around when nodes are removed
+  bool same_shape = added == replaced;
+  for (std::size_t i = 0; same_shape && i < added; ++i)
+    same_shape = window[i].depth == nodes[first + i].depth;
+
+  // Keys of the window whose value changes, by their old value.
+  struct changed_key {
+    std::size_t node;
+    std::pmr::string key;
+  };
+  std::pmr::vector<changed_key> changed(doc.resource());
+  std::string scratch, fresh;
+  if (indexed && same_shape) {
+    for (std::size_t i = 0; i < added; ++i) {
+      const node& n = window[i];
+      std::string_view value = input.substr(static_cast<std::size_t>(n.offset),
+                                            static_cast<std::size_t>(n.length));
+      if (n.flags & node::escaped) {
+        fresh.resize(value.size());
+        fresh.resize(unescape(value, fresh.data()));
+        value = fresh;
+      }
+      const std::string_view before_edit = doc.value(first + i, scratch);
+      if (before_edit != value)
+        changed.push_back({first + i, std::pmr::string(before_edit, doc.resource())});
+    }
+  }
+
+  // The subtrees open where the window starts are the ones holding node
+  // first - 1. The tape before `first` is not touched below.
+  std::pmr::vector<std::size_t> open(doc.resource());
+  for (std::size_t i = 0; i < first;) {
+    if (nodes[i].next >= first) open.push_back(i++);
+    else i = static_cast<std::size_t>(nodes[i].next);
+  }
+
+  // An edit that changes the shape of the tape renumbers every node after the
+  // window. The index then files keys under key ids (see document::key_id),
+  // which move with their nodes, so an entry stays where it is and only has
+  // its node renumbered. The keys of the window and of the children its nodes
+  // have past its end are dropped here, while the old source can still be
+  // read, and filed again once the tape is spliced. A table the new tape
+  // would fill past half is built again instead.
+  struct dropped_key {
+    std::size_t parent;
+    std::pmr::string key;
+  };
+  std::pmr::vector<dropped_key> dropped(doc.resource());
+  // Erases the entry of `filed_as`, node `i` before the tape changed, and
+  // keeps its key when the parent is outside the window, since it may have
+  // hidden a later sibling.
+  const auto drop = [&](std::size_t i, std::size_t filed_as, std::size_t parent) {
+    const std::string_view key = doc.value(i, scratch);
+    const std::uint64_t h = key_hash(document_access::key_id(doc, parent), hash_bytes(key));
+    if (document_access::erase_key(doc, filed_as, h) &&
+        (parent == element::root_index || parent < first))
+      dropped.push_back({parent, std::pmr::string(key, doc.resource())});
+  };
+  const bool renumber = indexed && !same_shape &&
+                        (nodes.size() + shift) * 2 <= document_access::table(doc).size();
+  std::pmr::vector<std::size_t> spilled_before(doc.resource());
+  if (renumber) {
+    document_access::key_ids(doc);
+    std::pmr::vector<std::size_t> path(open, doc.resource());
+    for (std::size_t i = first; i < last; ++i) {
+      while (!path.empty() && nodes[path.back()].depth >= nodes[i].depth) path.pop_back();
+      drop(i, i, path.empty() ? element::root_index : path.back());
+      path.push_back(i);
+    }
+    for (std::size_t i = last; i < nodes.size(); i = static_cast<std::size_t>(nodes[i].next)) {
+      while (!path.empty() && nodes[path.back()].depth >= nodes[i].depth) path.pop_back();
+      if (path.empty() || path.back() < first) break;
+      drop(i, i, path.back());
+      spilled_before.push_back(i);
+    }
+  }
+  // Where a child after the window was filed when its parent was not in the
+  // window: the subtree open at the start at the depth above it.
+  const std::pmr::vector<std::size_t> outer(open, doc.resource());
+  const auto parent_before = [&](std::uint32_t depth) {
+    for (auto a = outer.rbegin(); a != outer.rend(); ++a)
+      if (nodes[*a].depth + 1 == depth) return *a;
+    return element::root_index;
+  };
+
+  const std::size_t after = nodes.size() - last; // nodes after the window
+  document_access::release_decoded(doc);
+  // Makes room for the window in a vector kept by node index, or closes the
+  // gap it leaves.
+  const auto splice = [&](auto& by_node, auto fill) {
+    if (added < replaced) {
+      by_node.erase(by_node.begin() + static_cast<std::ptrdiff_t>(first + added),
+                    by_node.begin() + static_cast<std::ptrdiff_t>(last));
+    } else {
+      by_node.insert(by_node.begin() + static_cast<std::ptrdiff_t>(last), added - replaced, fill);
+    }
+  };
+  splice(nodes, node{});
+  if (hashed) splice(document_access::keep_hashes(doc), std::uint64_t{0});
+  if (interned) splice(document_access::symbols(doc), std::uint32_t{0});
+  if (renumber) {
+    std::pmr::vector<std::uint64_t>& ids = document_access::key_ids(doc);
+    splice(ids, std::uint64_t{0});
+    for (std::size_t i = first; i < first + added; ++i) ids[i] = document_access::new_key_id(doc);
+  }
+  std::copy(window.begin(), window.end(), nodes.begin() + static_cast<std::ptrdiff_t>(first));
+  for (std::size_t i = first + added; i < nodes.size(); ++i) {
+    nodes[i].offset += change.inserted - change.removed;
+    nodes[i].next += shift;
+  }
+
+  // Patch `next` of every subtree that was open where the window starts, and
+  // of the window's own nodes. After the window, hopping from sibling to
+  // sibling finds where each of them closes, and meets every child a window
+  // node has there.
+  // Only the window's nodes and the subtrees holding it change their hashes.
+  std::pmr::vector<std::size_t> ancestors(doc.resource());
+  if (hashed) ancestors = open;
+  std::pmr::vector<std::size_t> parents(doc.resource());
+  // Children after the window whose parent is a window node, before the edit
+  // or after it. Those that were not filed under one are filed under their
+  // parent before the window.
+  struct child {
+    std::size_t node;
+    std::size_t parent;
+    bool filed_before;
+  };
+  std::pmr::vector<child> spilled(doc.resource());
+  const auto close_to = [&](std::uint32_t d, std::size_t at) noexcept {
+    while (!open.empty() && nodes[open.back()].depth >= d) {
+      nodes[open.back()].next = at;
+      open.pop_back();
+    }
+  };
+  for (std::size_t i = first; i < first + added; ++i) {
+    close_to(nodes[i].depth, i);
+    if (indexed) parents.push_back(open.empty() ? element::root_index : open.back());
+    open.push_back(i);
+  }
+  std::size_t k = 0;
+  for (std::size_t i = first + added; i < nodes.size() && !open.empty();
+       i = static_cast<std::size_t>(nodes[i].next)) {
+    close_to(nodes[i].depth, i);
+    if (!renumber) continue;
+    const std::size_t parent = open.empty() ? element::root_index : open.back();
+    while (k < spilled_before.size() && spilled_before[k] < i - shift) ++k;
+    const bool was_spilled = k < spilled_before.size() && spilled_before[k] == i - shift;
+    if (parent != element::root_index && parent >= first)
+      spilled.push_back({i, parent, !was_spilled});
+    else if (was_spilled)
+      spilled.push_back({i, parent, false});
+  }
+  close_to(0, nodes.size());
+  document_access::set_source(doc, input);
+  if (interned) document_access::intern_nodes(doc, first, first + added);
+  if (hashed) {
+    for (std::size_t i = first + added; i-- > first;) document_access::rehash(doc, i, scratch);
+    for (auto a = ancestors.rbegin(); a != ancestors.rend(); ++a)
+      document_access::rehash(doc, *a, scratch);
+  }
+
+  if (!indexed) return {};
+  const auto file = [&](std::size_t i, std::size_t parent) {
+    const std::string_view key = doc.value(i, scratch);
+    document_access::insert_key(doc, i, parent, key,
+                                key_hash(document_access::key_id(doc, parent), hash_bytes(key)));
+  };
+  if (renumber) {
+    for (const child& c : spilled)
+      if (c.filed_before) drop(c.node, c.node - shift, parent_before(doc[c.node].depth));
+    // Entries of nodes after the window are the ones in [last, last + after).
+    // An empty slot's node is past that range, and with no branch to
+    // mispredict on this pass runs at memory speed.
+    for (index_slot& s : document_access::index(doc)) s.node += s.node - last < after ? shift : 0;
+    for (std::size_t i = first; i < first + added; ++i) file(i, parents[i - first]);
+    for (const child& c : spilled) file(c.node, c.parent);
+    // A dropped key may have hidden a later sibling, which now comes after
+    // the window unless the window still has the key.
+    for (const dropped_key& d : dropped) {
+      if (doc.find_child(d.parent, d.key) != element::root_index) continue;
+      const std::uint32_t depth = d.parent == element::root_index ? 0 : doc[d.parent].depth + 1;
+      const std::size_t stop = doc.children_end(d.parent);
+      for (std::size_t i = first + added; i < stop; i = static_cast<std::size_t>(doc[i].next)) {
+        if (doc[i].depth != depth || !doc.key_equals(i, d.key)) continue;
+        file(i, d.parent);
+        break;
+      }
+    }
+    return {};
+  }
+  if (!same_shape) {
+    doc.build_index();
+    return {};
+  }
+  // Drop each changed key, file it under its new value, then give its old
+  // value to the first sibling that still has it, which it may have hidden.
+  for (const changed_key& c : changed) {
+    const std::size_t parent = parents[c.node - first];
+    document_access::erase_key(
+        doc, c.node, key_hash(document_access::key_id(doc, parent), hash_bytes(c.key)));
+  }
+  for (const changed_key& c : changed) file(c.node, parents[c.node - first]);
+  for (const changed_key& c : changed) {
+    const std::size_t parent = parents[c.node - first];
+    const std::size_t stop = doc.children_end(parent);
+    for (std::size_t i = doc.children_begin(parent); i < stop;
+         i = static_cast<std::size_t>(doc[i].next)) {
+      if (!doc.key_equals(i, c.key)) continue;
+      document_access::insert_key(
+          doc, i, parent, c.key,
+          key_hash(document_access::key_id(doc, parent), hash_bytes(c.key)));
+      break;
+    }
+  }
+  return {};
+}
+
+// A reusable parser whose document lives in an arena owned by the parser.
+// Every parse resets the arena instead of freeing it, so once the arena has
+// grown to fit the inputs being parsed, parsing does no heap allocation at
+// all. The document returned by doc() stays valid until the next parse.
+class parser {
+public:
+  explicit parser(std::size_t initial_capacity = arena::default_block_size,
+                  backend scan = backend::automatic,
+                  std::pmr::memory_resource* upstream =
+                      std::pmr::new_delete_resource()) noexcept
+      : arena_(initial_capacity, upstream), doc_(&arena_), scan_(scan) {}
+
+  parser(const parser&) = delete;
+  parser& operator=(const parser&) = delete;
+
+  status parse(std::string_view input) {
+    doc_ = document{&arena_};
+    arena_.reset();
+    const status st = detail::build(input, doc_, scan_, max_depth_, comments_, hashes_);
+    if (st.ok() && index_) doc_.build_index();
+    if (st.ok() && intern_) doc_.intern();
+    return st;
+  }
+
+  // Whether to build the key index (document::build_index) after each parse.
+  void set_build_index(bool on) noexcept { index_ = on; }
+  // Whether to intern the document (document::intern) after each parse.
+  void set_intern(bool on) noexcept { intern_ = on; }
+  // The deepest nesting accepted; see papr::parse.
+  void set_max_depth(std::uint32_t depth) noexcept { max_depth_ = depth; }
+  // Whether to record where every comment is (document::comments).
+  void set_keep_comments(bool on) noexcept { comments_ = on; }
+  // Whether to hash every subtree while parsing (document::subtree_hash).
+  void set_hash_subtrees(bool on) noexcept { hashes_ = on; }
+
+  // Updates the document after an edit to its source; see papr::reparse.
+  status reparse(std::string_view input, const edit& change) {
+    return papr::reparse(doc_, input, change, scan_, max_depth_);
+  }
+
+  const document& doc() const noexcept { return doc_; }
+  const arena& memory() const noexcept { return arena_; }
+
+private:
+  arena arena_;
+  document doc_;
+  backend scan_;
+  bool index_ = false;
+  bool intern_ = false;
+  bool comments_ = false;
+  bool hashes_ = false;
+  std::uint32_t max_depth_ = default_max_depth;
+};
+
+} // namespace papr
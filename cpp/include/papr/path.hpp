@@ -0,0 +1,29 @@
+// papr - path.hpp
+// Key literals usable as template arguments, hashed at compile time.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "hash.hpp"
+
+namespace papr {
+
+// A string literal wrapped so it can be a template argument, for key paths
+// like doc.get<"Buttons", "1", "icon">(). Its hash is worked out by the
+// compiler, so a lookup through the key index does no hashing at run time.
+template <std::size_t N>
+struct fixed_string {
+  char data[N]{};
+  std::uint64_t hash = 0;
+
+  consteval fixed_string(const char (&literal)[N]) noexcept {
+    for (std::size_t i = 0; i < N; ++i) data[i] = literal[i];
+    hash = hash_bytes(view());
+  }
+
+  constexpr std::string_view view() const noexcept { return {data, N - 1}; }
+};
+
+} // namespace papr
@@ -0,0 +1,117 @@
+// papr - pretty.hpp
+// Formats a document in the aligned layout used throughout the README.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.hpp"
+#include "writer.hpp"
+
+namespace papr {
+
+namespace detail {
+
+// Display width of UTF-8 text: one column per code point.
+constexpr std::size_t display_width(std::string_view text) noexcept {
+  std::size_t width = 0;
+  for (const char c : text) width += (static_cast<unsigned char>(c) & 0xc0) != 0x80;
+  return width;
+}
+
+// Measures the columns a token takes once written.
+struct width_counter {
+  std::size_t width = 0;
+  void write(std::string_view bytes) noexcept { width += display_width(bytes); }
+};
+
+// Sinks for layout_pretty: one only measures, the other fills a buffer that
+// the measuring pass sized exactly.
+struct pretty_counter {
+  std::size_t size = 0;
+  void write(std::string_view bytes) noexcept { size += bytes.size(); }
+  void spaces(std::size_t n) noexcept { size += n; }
+};
+
+struct pretty_filler {
+  char* out;
+  void write(std::string_view bytes) noexcept {
+    std::memcpy(out, bytes.data(), bytes.size());
+    out += bytes.size();
+  }
+  void spaces(std::size_t n) noexcept {
+    std::memset(out, ' ', n);
+    out += n;
+  }
+};
+
+// The pretty layout: a key and its first child share a line as `key: child`;
+// every further sibling starts a new line, indented to the column of the
+// first one; a run of `;` closes the levels that end. Like minify(), the
+// last token gets no delimiter at all. `columns` holds the indent of each
+// depth along the current path and is rebuilt as the walk descends.
+template <class Out>
+void layout_pretty(const document& doc, std::pmr::vector<std::size_t>& columns, Out& out) {
+  const std::span<const node> nodes = doc.nodes();
+  if (nodes.empty()) return;
+  columns.assign(1, 0);
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    write_node(out, doc, i);
+    if (i + 1 == nodes.size()) {
+      out.write("\n");
+      break;
+    }
+    const std::uint32_t depth = nodes[i].depth;
+    const std::uint32_t next = nodes[i + 1].depth;
+    if (next > depth) {
+      width_counter key;
+      write_node(key, doc, i);
+      if (columns.size() <= next) columns.resize(next + 1);
+      columns[next] = columns[depth] + key.width + 2;
+      out.write(": ");
+      continue;
+    }
+    if (next == depth) {
+      out.write(",");
+    } else {
+      write_semicolons(out, depth - next);
+    }
+    out.write("\n");
+    out.spaces(columns[next]);
+  }
+}
+
+} // namespace detail
+
+// The exact number of bytes pretty() produces for `doc`.
+inline std::size_t pretty_size(const document& doc) {
+  std::pmr::vector<std::size_t> columns(doc.resource());
+  detail::pretty_counter counter;
+  detail::layout_pretty(doc, columns, counter);
+  return counter.size;
+}
+
+// Writes `doc` in the aligned layout to `out`, which must have room for
+// pretty_size(doc) bytes. Returns the number of bytes written.
+inline std::size_t pretty(const document& doc, char* out) {
+  std::pmr::vector<std::size_t> columns(doc.resource());
+  detail::pretty_filler filler{out};
+  detail::layout_pretty(doc, columns, filler);
+  return static_cast<std::size_t>(filler.out - out);
+}
+
+// Formats `doc` with one measuring pass and one filling pass, so the result
+// is allocated exactly once at its final size.
+inline std::string pretty(const document& doc) {
+  std::string text(pretty_size(doc), '\0');
+  pretty(doc, text.data());
+  return text;
+}
+
+} // namespace papr
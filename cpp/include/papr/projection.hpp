@@ -0,0 +1,153 @@
+// papr - projection.hpp
+// Parsing only the subtrees under a chosen set of key paths.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.hpp"
+#include "error.hpp"
+#include "escape.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// A set of key paths from the root, such as {"Version"} or {"Buttons", "1"},
+// kept as a trie of keys. A path selects the whole subtree of the key it ends
+// at; the keys along the way are kept too, so the document still reaches it.
+// The empty path selects everything.
+class projection {
+public:
+  static constexpr std::uint32_t none = ~0u; // a token outside every path
+  static constexpr std::uint32_t all = ~0u - 1; // a token inside a selected subtree
+
+  projection() { steps_.push_back({}); }
+
+  projection& add(std::span<const std::string_view> path) {
+    std::uint32_t at = 0;
+    for (const std::string_view key : path) {
+      std::uint32_t c = steps_[at].first_child;
+      while (c != none && steps_[c].key != key) c = steps_[c].next_sibling;
+      if (c == none) {
+        c = static_cast<std::uint32_t>(steps_.size());
+        steps_.push_back({std::string(key), none, steps_[at].first_child, false});
+        steps_[at].first_child = c;
+      }
+      at = c;
+    }
+    steps_[at].ends = true;
+    return *this;
+  }
+  projection& add(std::initializer_list<std::string_view> path) {
+    return add(std::span<const std::string_view>(path.begin(), path.size()));
+  }
+
+  // Where matching starts: the step of the root.
+  std::uint32_t root() const noexcept { return steps_[0].ends ? all : 0; }
+
+  // The step for a token under `parent`, or none when no path goes through
+  // it. `text` is the token as it appears in the source, escapes included
+  // when `escaped` is set.
+  std::uint32_t child(std::uint32_t parent, std::string_view text, bool escaped) const noexcept {
+    if (parent == all) return all;
+    for (std::uint32_t c = steps_[parent].first_child; c != none; c = steps_[c].next_sibling) {
+      const std::string_view key = steps_[c].key;
+      if (escaped ? unescaped_equals(text, key) : text == key)
+        return steps_[c].ends ? all : c;
+    }
+    return none;
+  }
+
+private:
+  struct step {
+    std::string key;
+    std::uint32_t first_child = none;
+    std::uint32_t next_sibling = none;
+    bool ends = false; // a path ends here
+  };
+
+  std::vector<step> steps_;
+};
+
+// Parses only the tokens `keep` selects into `doc`. The tape is what
+// papr::parse would build with every other subtree cut out. The subtree of a
+// key that is not selected is fast-forwarded over with the scanner. That
+// scan only tracks quotes, comments and depth, so an error inside skipped
+// text that is not one of those goes unreported. Everything that is parsed
+// is checked as usual.
+inline status parse_projected(std::string_view input, document& doc, const projection& keep,
+                              backend scan = backend::automatic,
+                              std::uint32_t max_depth = default_max_depth) {
+  PAPR_TRACE_SCOPE("papr::parse_projected");
+  using detail::document_access;
+  using detail::no_node;
+  doc.clear();
+  std::pmr::vector<node>& nodes = document_access::nodes(doc);
+  tokenizer tok{input, scan};
+
+  // The step of the key each open level hangs under.
+  std::pmr::vector<std::uint32_t> within(doc.resource());
+  within.push_back(keep.root());
+  std::uint32_t last = projection::none; // the step of the token before a delimiter
+  std::uint64_t open = no_node;
+  std::uint32_t depth = 0;
+  const auto close_to = [&](std::uint32_t d, std::uint64_t next) noexcept {
+    while (open != no_node && nodes[open].depth >= d) {
+      const std::uint64_t parent = nodes[open].next;
+      nodes[open].next = next;
+      open = parent;
+    }
+  };
+  const auto fail = [&](status st) {
+    doc.clear();
+    return st;
+  };
+
+  for (token t = tok.next();; t = tok.next()) {
+    switch (t.kind) {
+      case token_kind::text: {
+        last = keep.child(within[depth], t.text, t.has_escapes());
+        if (last == projection::none) break;
+        const std::uint64_t index = nodes.size();
+        close_to(depth, index);
+        nodes.push_back({tok.offset_of(t), t.text.size(), open, depth, t.flags});
+        PAPR_STAT_MAX(max_depth, depth);
+        open = index;
+        break;
+      }
+      case token_kind::colon:
+        if (depth == max_depth) return fail({error_code::depth_limit, tok.position() - 1});
+        if (last == projection::none) {
+          // The key was dropped: so is everything under it.
+          tok.skip_levels(1, max_depth - depth);
+          break;
+        }
+        ++depth;
+        if (within.size() <= depth) within.resize(depth + 1);
+        within[depth] = last;
+        break;
+      case token_kind::comma: break;
+      case token_kind::semicolon:
+        if (depth == 0) return fail({error_code::depth_underflow, tok.position() - 1});
+        --depth;
+        break;
+      case token_kind::end:
+        close_to(0, nodes.size());
+        document_access::set_source(doc, input);
+        return {};
+      case token_kind::error: return fail({tok.error(), tok.error_offset()});
+    }
+    if (t.kind != token_kind::text) last = projection::none;
+  }
+}
+
+} // namespace papr
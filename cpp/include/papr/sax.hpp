@@ -0,0 +1,353 @@
+// papr - sax.hpp
+// Streaming, event-driven parsing over input that arrives in chunks.
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "error.hpp"
+#include "escape.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// The events of a papr stream. A token is a key when a `:` follows it and a
+// value otherwise, so each token is reported once its delimiter has been seen.
+// Views are decoded and only valid for the duration of the call.
+template <class H>
+concept sax_handler = requires(H& h, std::string_view text) {
+  h.on_key(text);
+  h.on_value(text);
+  h.on_depth_up();   // `:`
+  h.on_sibling();    // `,`
+  h.on_depth_down(); // `;`
+};
+
+// Parses papr pushed at it in chunks of any size. Tokens that lie inside one
+// chunk are reported straight from it; only a token that straddles a chunk
+// boundary is copied, into a carry buffer that is reused for the next one. A
+// quoted token or `##` comment may span any number of chunks. Memory held by
+// the parser is bounded by the longest token, not by the input size.
+template <sax_handler Handler>
+class stream_parser {
+public:
+  explicit stream_parser(Handler& handler, backend scan = backend::automatic) noexcept
+      : handler_(handler), scanner_(&get_scanner(scan)) {}
+
+  // Consumes the next chunk of input. The chunk does not need to outlive the
+  // call.
+  status feed(std::string_view chunk);
+
+  // Ends the stream: flushes a trailing token and reports anything left open.
+  status finish();
+
+  // Restarts the parser for a new stream, keeping its buffers.
+  void reset() noexcept {
+    mode_ = mode::between;
+    error_ = {};
+    carry_.clear();
+    pending_ = {};
+    pending_flags_ = 0;
+    has_pending_ = false;
+    depth_ = 0;
+    consumed_ = 0;
+  }
+
+  std::uint32_t depth() const noexcept { return depth_; }
+  // The deepest nesting accepted; see papr::parse.
+  void set_max_depth(std::uint32_t depth) noexcept { max_depth_ = depth; }
+  // Bytes of input consumed so far.
+  std::uint64_t position() const noexcept { return consumed_; }
+
+private:
+  enum class mode : std::uint8_t {
+    between,       // skipping whitespace, expecting a token or delimiter
+    plain,         // inside a plain token
+    quoted,        // inside a quoted token
+    quoted_escape, // a quoted token's backslash ended the previous chunk
+    hash,          // a `#` ended the previous chunk
+    line_comment,
+    block_comment,
+    block_hash,    // a `#` inside a `##` comment ended the previous chunk
+  };
+
+  status fail(error_code code, std::uint64_t at) noexcept {
+    error_ = {code, static_cast<std::size_t>(at)};
+    return error_;
+  }
+
+  void set_pending(std::string_view text, std::uint8_t flags) noexcept {
+    PAPR_STAT_ADD(tokens, 1);
+    PAPR_STAT_ADD(quoted_tokens, (flags & token::quoted) ? 1 : 0);
+    PAPR_STAT_ADD(escaped_tokens, (flags & token::escaped) ? 1 : 0);
+    PAPR_STAT_MAX(max_depth, depth_);
+    pending_ = text;
+    pending_flags_ = flags;
+    has_pending_ = true;
+  }
+
+  std::string_view pending_value() {
+    if (!(pending_flags_ & token::escaped)) return pending_;
+    decoded_.resize(pending_.size());
+    decoded_.resize(unescape(pending_, decoded_.data()));
+    return decoded_;
+  }
+
+  // Finishes a plain token whose bytes end at `stop` in the current chunk.
+  void finish_plain(const char* chunk, std::size_t stop) {
+    std::string_view text;
+    if (carry_.empty()) {
+      text = {chunk + start_, stop - start_};
+    } else {
+      carry_.append(chunk + start_, stop - start_);
+      text = carry_;
+    }
+    while (!text.empty() && detail::is_space(text.back())) text.remove_suffix(1);
+    set_pending(text, 0);
+  }
+
+  void finish_quoted(const char* chunk, std::size_t close) {
+    if (carry_.empty()) {
+      set_pending({chunk + start_, close - start_}, quoted_flags_);
+    } else {
+      carry_.append(chunk + start_, close - start_);
+      set_pending(carry_, quoted_flags_);
+    }
+  }
+
+  Handler& handler_;
+  const scanner* scanner_;
+  mode mode_ = mode::between;
+  status error_;
+  std::string carry_;   // bytes of a token that straddles chunks
+  std::string decoded_; // scratch for escaped tokens
+  std::string_view pending_;
+  std::uint8_t pending_flags_ = 0;
+  std::uint8_t quoted_flags_ = 0;
+  bool has_pending_ = false; // a finished token still waiting for its delimiter
+  std::uint32_t depth_ = 0;
+  std::uint32_t max_depth_ = default_max_depth;
+  std::size_t start_ = 0;        // where the current token starts in the chunk
+  std::uint64_t consumed_ = 0;   // bytes of all previous chunks
+  std::uint64_t token_offset_ = 0; // where the current token or comment starts
+};
+
+template <sax_handler Handler>
+status stream_parser<Handler>::feed(std::string_view input) {
+  if (!error_.ok()) return error_;
+
+  const char* const chunk = input.data();
+  const char* const end = chunk + input.size();
+  const std::size_t size = input.size();
+  std::size_t i = 0;
+  start_ = 0;
+
+  // Continue whatever the previous chunk left open.
+  switch (mode_) {
+    case mode::quoted_escape:
+      if (size == 0) break;
+      if (detail::is_escapable(chunk[0])) quoted_flags_ |= token::escaped;
+      i = 1;
+      mode_ = mode::quoted;
+      break;
+    case mode::hash:
+    case mode::block_hash:
+      if (size == 0) break;
+      if (chunk[0] == '#') {
+        mode_ = mode_ == mode::hash ? mode::block_comment : mode::between;
+        i = 1;
+      } else {
+        mode_ = mode_ == mode::hash ? mode::line_comment : mode::block_comment;
+      }
+      break;
+    default: break;
+  }
+
+  while (i < size) {
+    switch (mode_) {
+      case mode::between: {
+        const char c = chunk[i];
+        if (detail::is_space(c)) {
+          ++i;
+          continue;
+        }
+        switch (c) {
+          case '#':
+            PAPR_STAT_ADD(comments, 1);
+            token_offset_ = consumed_ + i;
+            if (i + 1 == size) {
+              mode_ = mode::hash;
+            } else if (chunk[i + 1] == '#') {
+              mode_ = mode::block_comment;
+              ++i;
+            } else {
+              mode_ = mode::line_comment;
+            }
+            ++i;
+            continue;
+          case ':':
+          case ',':
+            if (!has_pending_) return fail(error_code::missing_token, consumed_ + i);
+            if (c == ':') {
+              if (depth_ == max_depth_) return fail(error_code::depth_limit, consumed_ + i);
+              handler_.on_key(pending_value());
+              ++depth_;
+              has_pending_ = false;
+              carry_.clear();
+              handler_.on_depth_up();
+            } else {
+              handler_.on_value(pending_value());
+              has_pending_ = false;
+              carry_.clear();
+              handler_.on_sibling();
+            }
+            ++i;
+            continue;
+          case ';':
+            if (has_pending_) {
+              handler_.on_value(pending_value());
+              has_pending_ = false;
+              carry_.clear();
+            }
+            if (depth_ == 0) return fail(error_code::depth_underflow, consumed_ + i);
+            --depth_;
+            handler_.on_depth_down();
+            ++i;
+            continue;
+          default:
+            if (has_pending_)
+              return fail(error_code::expected_delimiter, consumed_ + i);
+            token_offset_ = consumed_ + i;
+            if (c == '"') {
+              mode_ = mode::quoted;
+              quoted_flags_ = token::quoted;
+              start_ = ++i;
+            } else {
+              mode_ = mode::plain;
+              start_ = i;
+            }
+            continue;
+        }
+      }
+      case mode::plain: {
+        const char* hit = scanner_->find_structural(chunk + i, end);
+        if (hit == end) {
+          i = size;
+          break;
+        }
+        const auto stop = static_cast<std::size_t>(hit - chunk);
+        if (*hit == '"') return fail(error_code::unexpected_quote, consumed_ + stop);
+        finish_plain(chunk, stop);
+        mode_ = mode::between;
+        i = stop;
+        continue;
+      }
+      case mode::quoted: {
+        const char* hit = scanner_->find_quote_end(chunk + i, end);
+        if (hit == end) {
+          i = size;
+          break;
+        }
+        const auto at = static_cast<std::size_t>(hit - chunk);
+        if (*hit == '"') {
+          finish_quoted(chunk, at);
+          mode_ = mode::between;
+          i = at + 1;
+        } else if (at + 1 == size) {
+          mode_ = mode::quoted_escape;
+          i = size;
+        } else {
+          if (detail::is_escapable(chunk[at + 1])) quoted_flags_ |= token::escaped;
+          i = at + 2;
+        }
+        continue;
+      }
+      case mode::line_comment: {
+        const void* eol = std::memchr(chunk + i, '\n', size - i);
+        if (eol == nullptr) {
+          i = size;
+          break;
+        }
+        i = static_cast<std::size_t>(static_cast<const char*>(eol) - chunk) + 1;
+        mode_ = mode::between;
+        continue;
+      }
+      case mode::block_comment: {
+        const void* found = std::memchr(chunk + i, '#', size - i);
+        if (found == nullptr) {
+          i = size;
+          break;
+        }
+        const auto at = static_cast<std::size_t>(static_cast<const char*>(found) - chunk);
+        if (at + 1 == size) {
+          mode_ = mode::block_hash;
+          i = size;
+        } else if (chunk[at + 1] == '#') {
+          mode_ = mode::between;
+          i = at + 2;
+        } else {
+          i = at + 1;
+        }
+        continue;
+      }
+      default: i = size; break;
+    }
+  }
+
+  // Keep what the next chunk still needs: the start of an unfinished token, or
+  // a finished one that has not seen its delimiter yet.
+  if (mode_ == mode::plain || mode_ == mode::quoted || mode_ == mode::quoted_escape) {
+    carry_.append(chunk + start_, size - start_);
+  } else if (has_pending_ && pending_.data() != carry_.data()) {
+    carry_.assign(pending_);
+    pending_ = carry_;
+  }
+  consumed_ += size;
+  return {};
+}
+
+template <sax_handler Handler>
+status stream_parser<Handler>::finish() {
+  if (!error_.ok()) return error_;
+  switch (mode_) {
+    case mode::plain: {
+      std::string_view text = carry_;
+      while (!text.empty() && detail::is_space(text.back())) text.remove_suffix(1);
+      set_pending(text, 0);
+      break;
+    }
+    case mode::quoted:
+    case mode::quoted_escape:
+      return fail(error_code::unterminated_quote, token_offset_);
+    case mode::block_comment:
+    case mode::block_hash:
+      return fail(error_code::unterminated_comment, token_offset_);
+    default: break;
+  }
+  mode_ = mode::between;
+  if (has_pending_) {
+    handler_.on_value(pending_value());
+    has_pending_ = false;
+  }
+  carry_.clear();
+  return {};
+}
+
+// Runs a whole in-memory buffer through a stream_parser.
+template <sax_handler Handler>
+status parse_events(std::string_view input, Handler& handler,
+                    backend scan = backend::automatic,
+                    std::uint32_t max_depth = default_max_depth) {
+  stream_parser<Handler> parser{handler, scan};
+  parser.set_max_depth(max_depth);
+  if (status st = parser.feed(input); !st.ok()) return st;
+  return parser.finish();
+}
+
+} // namespace papr
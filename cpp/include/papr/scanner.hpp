@@ -0,0 +1,337 @@
+// papr - scanner.hpp
+// Structural-character scanning with scalar and SIMD backends.
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Rules 1-5 only give meaning to six bytes: `:` `,` `;` `#` `"` and `\`. The
+// scanner classifies input 64 bytes at a time into bitmasks of those bytes
+// and uses them to jump over token bodies. Define PAPR_NO_SIMD to build the
+// scalar backend only.
+#if !defined(PAPR_NO_SIMD)
+#if defined(__x86_64__) || defined(_M_X64)
+#define PAPR_HAS_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define PAPR_HAS_AVX2 1
+#define PAPR_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define PAPR_HAS_AVX2 1
+#define PAPR_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PAPR_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace papr {
+
+enum class backend : std::uint8_t {
+  automatic, // the best backend the running CPU supports
+  scalar,
+  sse2,
+  avx2,
+  neon,
+};
+
+constexpr const char* to_string(backend b) noexcept {
+  switch (b) {
+    case backend::automatic: return "automatic";
+    case backend::scalar: return "scalar";
+    case backend::sse2: return "sse2";
+    case backend::avx2: return "avx2";
+    case backend::neon: return "neon";
+  }
+  return "unknown";
+}
+
+// One bit per byte of a 64-byte block, bit i standing for byte i.
+struct block_masks {
+  std::uint64_t delimiter = 0; // `:` `,` `;`
+  std::uint64_t hash = 0;      // `#`
+  std::uint64_t quote = 0;     // `"`
+  std::uint64_t backslash = 0; // `\`
+};
+
+// The entry points of one backend. find_structural returns the first byte
+// that ends a plain token, find_quote_end the first `"` or `\`; both return
+// `end` when there is none and never read at or past `end`.
+struct scanner {
+  backend kind;
+  block_masks (*classify)(const char* block) noexcept;
+  const char* (*find_structural)(const char* p, const char* end) noexcept;
+  const char* (*find_quote_end)(const char* p, const char* end) noexcept;
+};
+
+namespace detail {
+
+inline constexpr std::size_t block_size = 64;
+
+namespace scalar {
+
+inline block_masks classify(const char* block) noexcept {
+  block_masks m;
+  for (std::size_t i = 0; i < block_size; ++i) {
+    const std::uint64_t bit = std::uint64_t{1} << i;
+    switch (block[i]) {
+      case ':': case ',': case ';': m.delimiter |= bit; break;
+      case '#': m.hash |= bit; break;
+      case '"': m.quote |= bit; break;
+      case '\\': m.backslash |= bit; break;
+      default: break;
+    }
+  }
+  return m;
+}
+
+inline const char* find_structural(const char* p, const char* end) noexcept {
+  while (p < end && *p != ':' && *p != ',' && *p != ';' && *p != '#' &&
+         *p != '"')
+    ++p;
+  return p;
+}
+
+inline const char* find_quote_end(const char* p, const char* end) noexcept {
+  while (p < end && *p != '"' && *p != '\\') ++p;
+  return p;
+}
+
+} // namespace scalar
+
+#if defined(PAPR_HAS_SSE2)
+namespace sse2 {
+
+inline std::uint64_t eq_mask(const __m128i (&v)[4], char c) noexcept {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::uint64_t bits = 0;
+  for (int i = 0; i < 4; ++i) {
+    const auto m = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v[i], needle)));
+    bits |= std::uint64_t{m} << (16 * i);
+  }
+  return bits;
+}
+
+inline block_masks classify(const char* block) noexcept {
+  const __m128i v[4] = {
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48))};
+  return {eq_mask(v, ':') | eq_mask(v, ',') | eq_mask(v, ';'),
+          eq_mask(v, '#'), eq_mask(v, '"'), eq_mask(v, '\\')};
+}
+
+inline const char* find_structural(const char* p, const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.delimiter | m.hash | m.quote)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_structural(p, end);
+}
+
+inline const char* find_quote_end(const char* p, const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.quote | m.backslash)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_quote_end(p, end);
+}
+
+} // namespace sse2
+#endif
+
+#if defined(PAPR_HAS_AVX2)
+namespace avx2 {
+
+PAPR_TARGET_AVX2 inline std::uint64_t eq_mask(__m256i lo, __m256i hi,
+                                               char c) noexcept {
+  const __m256i needle = _mm256_set1_epi8(c);
+  const auto l = static_cast<std::uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)));
+  const auto h = static_cast<std::uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)));
+  return std::uint64_t{l} | (std::uint64_t{h} << 32);
+}
+
+PAPR_TARGET_AVX2 inline block_masks classify(const char* block) noexcept {
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i hi =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+  return {eq_mask(lo, hi, ':') | eq_mask(lo, hi, ',') | eq_mask(lo, hi, ';'),
+          eq_mask(lo, hi, '#'), eq_mask(lo, hi, '"'), eq_mask(lo, hi, '\\')};
+}
+
+PAPR_TARGET_AVX2 inline const char* find_structural(const char* p,
+                                                    const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.delimiter | m.hash | m.quote)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_structural(p, end);
+}
+
+PAPR_TARGET_AVX2 inline const char* find_quote_end(const char* p,
+                                                   const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.quote | m.backslash)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_quote_end(p, end);
+}
+
+inline bool supported() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+} // namespace avx2
+#endif
+
+#if defined(PAPR_HAS_NEON)
+namespace neon {
+
+inline std::uint64_t to_bits(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2,
+                             uint8x16_t m3) noexcept {
+  const uint8x16_t weight = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                             0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+  uint8x16_t a = vpaddq_u8(vandq_u8(m0, weight), vandq_u8(m1, weight));
+  uint8x16_t b = vpaddq_u8(vandq_u8(m2, weight), vandq_u8(m3, weight));
+  a = vpaddq_u8(a, b);
+  a = vpaddq_u8(a, a);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(a), 0);
+}
+
+inline std::uint64_t eq_mask(const uint8x16_t (&v)[4], char c) noexcept {
+  const uint8x16_t needle = vdupq_n_u8(static_cast<std::uint8_t>(c));
+  return to_bits(vceqq_u8(v[0], needle), vceqq_u8(v[1], needle),
+                 vceqq_u8(v[2], needle), vceqq_u8(v[3], needle));
+}
+
+inline block_masks classify(const char* block) noexcept {
+  const auto* b = reinterpret_cast<const std::uint8_t*>(block);
+  const uint8x16_t v[4] = {vld1q_u8(b), vld1q_u8(b + 16), vld1q_u8(b + 32),
+                           vld1q_u8(b + 48)};
+  return {eq_mask(v, ':') | eq_mask(v, ',') | eq_mask(v, ';'),
+          eq_mask(v, '#'), eq_mask(v, '"'), eq_mask(v, '\\')};
+}
+
+inline const char* find_structural(const char* p, const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.delimiter | m.hash | m.quote)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_structural(p, end);
+}
+
+inline const char* find_quote_end(const char* p, const char* end) noexcept {
+  for (; end - p >= 64; p += 64) {
+    const block_masks m = classify(p);
+    if (const std::uint64_t bits = m.quote | m.backslash)
+      return p + std::countr_zero(bits);
+  }
+  return scalar::find_quote_end(p, end);
+}
+
+} // namespace neon
+#endif
+
+inline constexpr scanner scalar_scanner{backend::scalar, scalar::classify,
+                                        scalar::find_structural,
+                                        scalar::find_quote_end};
+#if defined(PAPR_HAS_SSE2)
+inline constexpr scanner sse2_scanner{backend::sse2, sse2::classify,
+                                      sse2::find_structural,
+                                      sse2::find_quote_end};
+#endif
+#if defined(PAPR_HAS_AVX2)
+inline constexpr scanner avx2_scanner{backend::avx2, avx2::classify,
+                                      avx2::find_structural,
+                                      avx2::find_quote_end};
+#endif
+#if defined(PAPR_HAS_NEON)
+inline constexpr scanner neon_scanner{backend::neon, neon::classify,
+                                      neon::find_structural,
+                                      neon::find_quote_end};
+#endif
+
+inline const scanner& detect_scanner() noexcept {
+#if defined(PAPR_HAS_AVX2)
+  if (avx2::supported()) return avx2_scanner;
+#endif
+#if defined(PAPR_HAS_SSE2)
+  return sse2_scanner;
+#elif defined(PAPR_HAS_NEON)
+  return neon_scanner;
+#else
+  return scalar_scanner;
+#endif
+}
+
+} // namespace detail
+
+// True when `b` was compiled in and the running CPU can execute it.
+inline bool is_supported(backend b) noexcept {
+  switch (b) {
+    case backend::automatic:
+    case backend::scalar: return true;
+#if defined(PAPR_HAS_SSE2)
+    case backend::sse2: return true;
+#endif
+#if defined(PAPR_HAS_AVX2)
+    case backend::avx2: return detail::avx2::supported();
+#endif
+#if defined(PAPR_HAS_NEON)
+    case backend::neon: return true;
+#endif
+    default: return false;
+  }
+}
+
+// Returns the scanner for `b`. CPU detection for backend::automatic runs once
+// per process; an unsupported backend falls back to the scalar one.
+inline const scanner& get_scanner(backend b = backend::automatic) noexcept {
+  switch (b) {
+    case backend::automatic: {
+      static const scanner& best = detail::detect_scanner();
+      return best;
+    }
+#if defined(PAPR_HAS_SSE2)
+    case backend::sse2: return detail::sse2_scanner;
+#endif
+#if defined(PAPR_HAS_AVX2)
+    case backend::avx2:
+      if (detail::avx2::supported()) return detail::avx2_scanner;
+      break;
+#endif
+#if defined(PAPR_HAS_NEON)
+    case backend::neon: return detail::neon_scanner;
+#endif
+    default: break;
+  }
+  return detail::scalar_scanner;
+}
+
+} // namespace papr
@@ -0,0 +1,196 @@
+// papr - snapshot.hpp
+// Immutable parsed documents that readers share while a writer replaces them.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cache.hpp"
+#include "document.hpp"
+#include "epoch.hpp"
+#include "error.hpp"
+#include "parser.hpp"
+
+namespace papr {
+
+// How a snapshot is built; the same choices as for the document cache.
+using snapshot_options = cache_options;
+
+// One version of a document, with the text it was parsed from. It is
+// complete before anyone can reach it and never changes afterwards: escapes
+// are decoded and the optional index and symbols are built up front, so
+// every read is safe from any number of threads.
+class snapshot {
+public:
+  // Parses `text`, which the snapshot takes over.
+  static status make(std::string text, std::unique_ptr<const snapshot>& out,
+                     const snapshot_options& options = {}) {
+    std::unique_ptr<snapshot> s{new snapshot};
+    s->text_ = std::move(text);
+    if (status st = s->build(s->text_, options); !st.ok()) return st;
+    out = std::move(s);
+    return {};
+  }
+
+  // Reads and parses the file at `path`. The snapshot keeps its own copy of
+  // the bytes, so later writes to the file never reach it.
+  static status open(const char* path, std::unique_ptr<const snapshot>& out,
+                     const snapshot_options& options = {}) {
+    std::unique_ptr<snapshot> s{new snapshot};
+    if (status st = detail::read_file(path, s->text_); !st.ok()) return st;
+    if (status st = s->build(s->text_, options); !st.ok()) return st;
+    out = std::move(s);
+    return {};
+  }
+
+  const document& doc() const noexcept { return doc_; }
+  std::string_view text() const noexcept { return doc_.source(); }
+  // Counts the snapshots published through one handle, starting at 1.
+  std::uint64_t version() const noexcept { return version_; }
+
+private:
+  friend class snapshot_handle;
+  snapshot() = default;
+
+  status build(std::string_view text, const snapshot_options& options) {
+    if (status st = detail::build(text, doc_, options.scan, options.max_depth, false,
+                                  options.hashes);
+        !st.ok())
+      return st;
+    if (options.index) doc_.build_index();
+    if (options.intern) doc_.intern();
+    doc_.materialize();
+    return {};
+  }
+
+  std::string text_;
+  document doc_;
+  mutable std::uint64_t version_ = 0; // set once, when published
+};
+
+// Holds the current snapshot of a document that is hot-reloaded while many
+// threads read it. Readers take no lock: read() marks the calling thread as
+// active in the current epoch, loads the snapshot pointer, and clears the
+// mark when its guard goes away. publish() swaps the pointer and bumps the
+// epoch. A replaced snapshot is freed by a later publish() or reclaim() once
+// no reader that started before the swap is still active.
+//
+// The marks live in a fixed array of reader slots (detail::epoch_domain),
+// which only has to be as large as the number of reads in flight at once.
+// When every slot is taken, read() spins until one frees up.
+class snapshot_handle {
+public:
+  class reader;
+
+  explicit snapshot_handle(std::size_t reader_slots = 256)
+      : epochs_(reader_slots) {}
+  snapshot_handle(const snapshot_handle&) = delete;
+  snapshot_handle& operator=(const snapshot_handle&) = delete;
+  // No reader may still be active.
+  ~snapshot_handle() {
+    delete current_.load(std::memory_order_relaxed);
+    for (const retired& r : retired_) delete r.old;
+  }
+
+  // The current snapshot, pinned until the reader is destroyed. It is null
+  // when nothing was published yet.
+  reader read() const noexcept;
+
+  // Makes `next` the current snapshot. Readers that already hold the old one
+  // keep it; new readers see `next`.
+  void publish(std::unique_ptr<const snapshot> next);
+
+  // Parses `text` and publishes it. On failure the current snapshot stays.
+  status publish(std::string text, const snapshot_options& options = {}) {
+    std::unique_ptr<const snapshot> next;
+    if (status st = snapshot::make(std::move(text), next, options); !st.ok()) return st;
+    publish(std::move(next));
+    return {};
+  }
+
+  // Frees every replaced snapshot that no active reader can still see.
+  void reclaim();
+
+  // Replaced snapshots still waiting for their readers.
+  std::size_t retired_count() const {
+    std::lock_guard lock{writer_};
+    return retired_.size();
+  }
+
+private:
+  struct retired {
+    const snapshot* old;
+    std::uint64_t epoch; // the epoch it was replaced in
+  };
+
+  void reclaim_locked();
+
+  std::atomic<const snapshot*> current_{nullptr};
+  detail::epoch_domain epochs_;
+
+  mutable std::mutex writer_; // publishers only; never taken by readers
+  std::vector<retired> retired_;
+  std::uint64_t versions_ = 0;
+};
+
+// Pins one snapshot for as long as it lives. Move-only.
+class snapshot_handle::reader {
+public:
+  reader(reader&&) noexcept = default;
+  reader& operator=(reader&&) = delete;
+
+  const snapshot* get() const noexcept { return snapshot_; }
+  const snapshot& operator*() const noexcept { return *snapshot_; }
+  const snapshot* operator->() const noexcept { return snapshot_; }
+  explicit operator bool() const noexcept { return snapshot_ != nullptr; }
+
+private:
+  friend class snapshot_handle;
+  reader(detail::epoch_domain::guard active, const snapshot* snap) noexcept
+      : active_(std::move(active)), snapshot_(snap) {}
+
+  detail::epoch_domain::guard active_;
+  const snapshot* snapshot_;
+};
+
+inline snapshot_handle::reader snapshot_handle::read() const noexcept {
+  detail::epoch_domain::guard active = epochs_.enter();
+  return {std::move(active), current_.load(std::memory_order_seq_cst)};
+}
+
+inline void snapshot_handle::publish(std::unique_ptr<const snapshot> next) {
+  std::lock_guard lock{writer_};
+  next->version_ = ++versions_;
+  const snapshot* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+  const std::uint64_t e = epochs_.advance();
+  if (old != nullptr) retired_.push_back({old, e});
+  reclaim_locked();
+}
+
+inline void snapshot_handle::reclaim() {
+  std::lock_guard lock{writer_};
+  reclaim_locked();
+}
+
+inline void snapshot_handle::reclaim_locked() {
+  if (retired_.empty()) return;
+  const std::uint64_t oldest = epochs_.oldest();
+  std::size_t kept = 0;
+  for (const retired& r : retired_) {
+    if (r.epoch < oldest) {
+      delete r.old;
+    } else {
+      retired_[kept++] = r;
+    }
+  }
+  retired_.resize(kept);
+}
+
+} // namespace papr
@@ -0,0 +1,74 @@
+// papr - stats.hpp
+// Compile-time gated counters and tracing hooks for the parse path.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace papr {
+
+// What the parse path has done on the calling thread. The counters only move
+// when PAPR_ENABLE_STATS is defined; otherwise every hook below expands to
+// nothing and the counters stay zero.
+struct parse_stats {
+  std::uint64_t bytes_scanned = 0;   // input handed to a parser, tokenizer or stream
+  std::uint64_t tokens = 0;          // text tokens the tokenizers produced
+  std::uint64_t quoted_tokens = 0;   // of which quoted
+  std::uint64_t escaped_tokens = 0;  // of which contained escapes
+  std::uint64_t comments = 0;        // `#` and `##` comments skipped
+  std::uint64_t max_depth = 0;       // deepest token seen
+  std::uint64_t arena_bytes = 0;     // bytes handed out by papr::arena
+  std::uint64_t index_builds = 0;    // key index tables built from scratch
+  std::uint64_t rehashes = 0;        // subtree hashes recomputed after the parse
+
+  parse_stats& operator+=(const parse_stats& other) noexcept {
+    bytes_scanned += other.bytes_scanned;
+    tokens += other.tokens;
+    quoted_tokens += other.quoted_tokens;
+    escaped_tokens += other.escaped_tokens;
+    comments += other.comments;
+    max_depth = std::max(max_depth, other.max_depth);
+    arena_bytes += other.arena_bytes;
+    index_builds += other.index_builds;
+    rehashes += other.rehashes;
+    return *this;
+  }
+};
+
+namespace detail {
+
+// Counters are per thread, so counting is a plain increment. Work done on
+// papr's own worker threads is added to the thread that started it.
+inline parse_stats& thread_stats() noexcept {
+  thread_local parse_stats stats;
+  return stats;
+}
+
+} // namespace detail
+
+// The calling thread's counters since the last reset_stats().
+inline parse_stats stats() noexcept { return detail::thread_stats(); }
+inline void reset_stats() noexcept { detail::thread_stats() = {}; }
+
+} // namespace papr
+
+#if defined(PAPR_ENABLE_STATS)
+#define PAPR_STAT_ADD(field, n) (::papr::detail::thread_stats().field += (n))
+#define PAPR_STAT_MAX(field, v)                                          \
+  do {                                                                   \
+    ::papr::parse_stats& papr_stats_ = ::papr::detail::thread_stats();   \
+    papr_stats_.field = std::max<std::uint64_t>(papr_stats_.field, (v)); \
+  } while (0)
+#else
+#define PAPR_STAT_ADD(field, n) ((void)0)
+#define PAPR_STAT_MAX(field, v) ((void)0)
+#endif
+
+// Marks the rest of the enclosing scope as one phase of a parse, named by a
+// string literal such as "papr::parse". Define it before including papr to
+// forward the phases to a profiler, e.g. for Tracy:
+//
+//   #define PAPR_TRACE_SCOPE(name) ZoneScopedN(name)
+#ifndef PAPR_TRACE_SCOPE
+#define PAPR_TRACE_SCOPE(name) ((void)0)
+#endif
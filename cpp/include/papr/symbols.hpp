@@ -0,0 +1,143 @@
+// papr - symbols.hpp
+// Interned token values, numbered with 32-bit symbol ids.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "hash.hpp"
+
+namespace papr {
+
+namespace detail {
+
+// An estimate of the heap bytes of an unordered map: a pointer per bucket,
+// and per entry a node holding the entry, a link and a cached hash.
+template <class Map>
+std::size_t hash_map_bytes(const Map& map) noexcept {
+  return map.bucket_count() * sizeof(void*) +
+         map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+// A text together with its hash_bytes(), for looking a symbol up without
+// hashing it again.
+struct symbol_key {
+  std::string_view text;
+  std::uint64_t hash;
+};
+
+// The symbol map hashes with hash_bytes, so a key hashed at compile time
+// (fixed_string) finds its symbol without touching its text until the final
+// compare.
+struct symbol_hash {
+  using is_transparent = void;
+  std::size_t operator()(std::string_view text) const noexcept {
+    return static_cast<std::size_t>(hash_bytes(text));
+  }
+  std::size_t operator()(const symbol_key& key) const noexcept {
+    return static_cast<std::size_t>(key.hash);
+  }
+};
+
+struct symbol_equal {
+  using is_transparent = void;
+  bool operator()(std::string_view a, std::string_view b) const noexcept { return a == b; }
+  bool operator()(const symbol_key& a, std::string_view b) const noexcept { return a.text == b; }
+  bool operator()(std::string_view a, const symbol_key& b) const noexcept { return a == b.text; }
+};
+
+} // namespace detail
+
+// Each distinct string is stored once and numbered in the order it was first
+// seen. intern only keeps a view, so whoever calls it keeps the text alive;
+// intern_copy keeps a copy in the table's own memory. A table is move-only,
+// since its views may point into that memory.
+class symbol_table {
+public:
+  static constexpr std::uint32_t none = ~std::uint32_t{0};
+
+  explicit symbol_table(std::pmr::memory_resource* resource =
+                            std::pmr::get_default_resource()) noexcept
+      : ids_(resource), texts_(resource), blocks_(resource) {}
+
+  symbol_table(const symbol_table&) = delete;
+  symbol_table& operator=(const symbol_table&) = delete;
+  symbol_table(symbol_table&&) noexcept = default;
+
+  // The id of `text`, which is added if it is new.
+  std::uint32_t intern(std::string_view text) {
+    const auto [it, inserted] = ids_.try_emplace(text, static_cast<std::uint32_t>(texts_.size()));
+    if (inserted) texts_.push_back(text);
+    return it->second;
+  }
+
+  // The id of `text`, which is copied into the table if it is new, so that
+  // `text` need not outlive it.
+  std::uint32_t intern_copy(std::string_view text) {
+    if (const std::uint32_t id = find(text, hash_bytes(text)); id != none) return id;
+    return intern(store(text));
+  }
+
+  // The id of `text`, or none if it was never interned.
+  std::uint32_t find(std::string_view text) const noexcept {
+    const auto it = ids_.find(text);
+    return it == ids_.end() ? none : it->second;
+  }
+
+  // The same lookup with hash_bytes(text) already computed.
+  std::uint32_t find(std::string_view text, std::uint64_t hash) const noexcept {
+    const auto it = ids_.find(detail::symbol_key{text, hash});
+    return it == ids_.end() ? none : it->second;
+  }
+
+  std::string_view text(std::uint32_t id) const noexcept { return texts_[id]; }
+  std::size_t size() const noexcept { return texts_.size(); }
+  bool empty() const noexcept { return texts_.empty(); }
+  // Heap bytes of the table and of its copies, not of the text it views.
+  std::size_t memory_usage() const noexcept {
+    std::size_t bytes = detail::hash_map_bytes(ids_) +
+                        texts_.capacity() * sizeof(std::string_view) +
+                        blocks_.capacity() * sizeof(std::pmr::string);
+    for (const std::pmr::string& block : blocks_) bytes += block.capacity();
+    return bytes;
+  }
+
+  void reserve(std::size_t n) {
+    ids_.reserve(n);
+    texts_.reserve(n);
+  }
+  void clear() noexcept {
+    ids_.clear();
+    texts_.clear();
+    blocks_.clear();
+  }
+
+private:
+  static constexpr std::size_t block_size = 4096;
+
+  // Appends `text` to the last block, or to a new one when it does not fit.
+  // A block never grows past the capacity it was given, so earlier copies
+  // never move.
+  std::string_view store(std::string_view text) {
+    if (blocks_.empty() || blocks_.back().capacity() - blocks_.back().size() < text.size())
+      blocks_.emplace_back().reserve(std::max(block_size, text.size()));
+    std::pmr::string& block = blocks_.back();
+    const std::size_t at = block.size();
+    block.append(text);
+    return {block.data() + at, text.size()};
+  }
+
+  std::pmr::unordered_map<std::string_view, std::uint32_t, detail::symbol_hash,
+                          detail::symbol_equal>
+      ids_;
+  std::pmr::vector<std::string_view> texts_;
+  std::pmr::vector<std::pmr::string> blocks_; // what intern_copy copied
+};
+
+} // namespace papr
@@ -0,0 +1,297 @@
+// papr - tokenizer.hpp
+// Zero-copy pull tokenizer for the papr format.
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "error.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+
+namespace papr {
+
+namespace detail {
+
+constexpr bool is_space(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Characters that a backslash escapes inside a quoted token. Rule 4 names
+// `\"`; `\\` is accepted as well so that a quoted token can end in a
+// backslash. A backslash in front of anything else is taken literally.
+constexpr bool is_escapable(char c) noexcept { return c == '"' || c == '\\'; }
+
+} // namespace detail
+
+// Rule 1 puts no bound on nesting. Every parser stops at this depth by
+// default, so hostile input cannot make a document that code walking it
+// recursively would overflow its stack on; each takes its own limit as well.
+inline constexpr std::uint32_t default_max_depth = 4096;
+
+enum class token_kind : std::uint8_t {
+  text,      // a plain or quoted token
+  colon,     // `:`  (Rule 1)
+  comma,     // `,`  (Rule 2)
+  semicolon, // `;`  (Rule 3)
+  end,       // the input is exhausted
+  error,     // see tokenizer::error()
+};
+
+// A token is a view straight into the tokenizer's input. For plain tokens the
+// text is already trimmed (Rule 4); for quoted tokens it is the bytes between
+// the quotes, with any `\"` escape sequences left in place. Tokens flagged as
+// escaped have to go through papr::decode (escape.hpp) to get their value.
+struct token {
+  enum flag : std::uint8_t { quoted = 1, escaped = 2 };
+
+  token_kind kind = token_kind::end;
+  std::uint8_t flags = 0;
+  std::string_view text;
+
+  constexpr bool is_text() const noexcept { return kind == token_kind::text; }
+  constexpr bool is_quoted() const noexcept { return flags & quoted; }
+  constexpr bool has_escapes() const noexcept { return flags & escaped; }
+};
+
+// Where a comment lies in the source: from its `#` up to the end of its line,
+// newline excluded, or through the closing `##`.
+struct comment_range {
+  std::uint64_t offset = 0;
+  std::uint64_t length = 0;
+};
+
+// Pulls tokens and delimiters out of a buffer one at a time. Comments (Rule 5)
+// and insignificant whitespace are skipped. The tokenizer never allocates
+// unless it is recording comments; the input must outlive every token handed
+// out. Token bodies are skipped with the
+// scanner for `scan`, which defaults to the best one the CPU supports.
+//
+// Besides lexing, the tokenizer rejects the few sequences that are invalid no
+// matter what the depth is: text directly after a finished token, and a `:` or
+// `,` with no token in front of it. Once an error is reported every further
+// call to next() returns token_kind::error again.
+class tokenizer {
+public:
+  explicit tokenizer(std::string_view input,
+                     backend scan = backend::automatic) noexcept
+      : input_(input), scanner_(&get_scanner(scan)) {
+    PAPR_STAT_ADD(bytes_scanned, input.size());
+  }
+
+  token next();
+
+  // Skips the text of `levels` open levels, up to and including the `;` that
+  // closes the outermost of them, or to the end of the input. Only quotes,
+  // comments and depth are tracked: an unterminated token or comment, or a
+  // `:` that opens more than `room` levels, is reported by the next call to
+  // next(), and nothing else in the skipped text is checked.
+  bool skip_levels(std::uint32_t levels, std::uint32_t room);
+
+  // Appends every comment skipped from now on to `out`, or stops recording
+  // when it is null. Skipping stays a memchr either way.
+  void record_comments(std::pmr::vector<comment_range>* out) noexcept { comments_ = out; }
+
+  constexpr std::string_view input() const noexcept { return input_; }
+  constexpr std::size_t position() const noexcept { return pos_; }
+  constexpr backend scanner_backend() const noexcept { return scanner_->kind; }
+
+  // Byte offset of a token's text within the input.
+  std::size_t offset_of(const token& tok) const noexcept {
+    return static_cast<std::size_t>(tok.text.data() - input_.data());
+  }
+
+  constexpr error_code error() const noexcept { return error_; }
+  constexpr std::size_t error_offset() const noexcept { return error_offset_; }
+
+private:
+  token fail(error_code code, std::size_t at) noexcept {
+    error_ = code;
+    error_offset_ = at;
+    pos_ = input_.size();
+    return {token_kind::error, 0, {}};
+  }
+
+  bool skip_comment();
+  token quoted_token() noexcept;
+  token plain_token() noexcept;
+
+  std::string_view input_;
+  const scanner* scanner_;
+  std::pmr::vector<comment_range>* comments_ = nullptr;
+  std::size_t pos_ = 0;
+  std::size_t error_offset_ = 0;
+  error_code error_ = error_code::success;
+  bool after_text_ = false;
+};
+
+inline token tokenizer::next() {
+  if (error_ != error_code::success) return {token_kind::error, 0, {}};
+
+  const char* const data = input_.data();
+  const std::size_t size = input_.size();
+  for (;;) {
+    while (pos_ < size && detail::is_space(data[pos_])) ++pos_;
+    if (pos_ == size) return {token_kind::end, 0, {}};
+
+    token_kind kind;
+    switch (data[pos_]) {
+      case '#':
+        if (!skip_comment()) return fail(error_code::unterminated_comment, pos_);
+        continue;
+      case ':': kind = token_kind::colon; break;
+      case ',': kind = token_kind::comma; break;
+      case ';': kind = token_kind::semicolon; break;
+      case '"':
+        if (after_text_) return fail(error_code::expected_delimiter, pos_);
+        return quoted_token();
+      default:
+        if (after_text_) return fail(error_code::expected_delimiter, pos_);
+        return plain_token();
+    }
+
+    if (kind != token_kind::semicolon && !after_text_)
+      return fail(error_code::missing_token, pos_);
+    after_text_ = false;
+    return {kind, 0, input_.substr(pos_++, 1)};
+  }
+}
+
+// Rule 5: `#` runs to the end of the line, `##` runs to the next `##`.
+inline bool tokenizer::skip_comment() {
+  PAPR_STAT_ADD(comments, 1);
+  const std::size_t start = pos_;
+  std::size_t stop;
+  if (pos_ + 1 < input_.size() && input_[pos_ + 1] == '#') {
+    const std::size_t close = input_.find("##", pos_ + 2);
+    if (close == std::string_view::npos) return false;
+    stop = pos_ = close + 2;
+  } else {
+    const std::size_t eol = input_.find('\n', pos_ + 1);
+    stop = eol == std::string_view::npos ? input_.size() : eol;
+    pos_ = eol == std::string_view::npos ? input_.size() : eol + 1;
+  }
+  if (comments_ != nullptr) comments_->push_back({start, stop - start});
+  return true;
+}
+
+// Whole blocks are classified at once and their `:` and `;` counted straight
+// from the delimiter mask; only quotes and comments are stepped through.
+inline bool tokenizer::skip_levels(std::uint32_t levels, std::uint32_t room) {
+  const char* const data = input_.data();
+  const char* const end = data + input_.size();
+  std::uint32_t open = levels;
+  after_text_ = false;
+  // Applies one delimiter; true once the outermost level is closed.
+  const auto delimiter = [&](std::size_t at) noexcept {
+    if (data[at] == ':') {
+      ++open;
+    } else if (data[at] == ';') {
+      return --open == 0;
+    }
+    return false;
+  };
+  while (pos_ < input_.size()) {
+    if (input_.size() - pos_ >= detail::block_size) {
+      const block_masks m = scanner_->classify(data + pos_);
+      const std::uint64_t special = m.hash | m.quote;
+      std::uint64_t d = m.delimiter & (special ? (special & (0 - special)) - 1 : ~std::uint64_t{0});
+      for (; d != 0; d &= d - 1) {
+        const std::size_t at = pos_ + static_cast<std::size_t>(std::countr_zero(d));
+        if (open >= room && data[at] == ':') {
+          fail(error_code::depth_limit, at);
+          return false;
+        }
+        if (delimiter(at)) {
+          pos_ = at + 1;
+          return true;
+        }
+      }
+      if (special == 0) {
+        pos_ += detail::block_size;
+        continue;
+      }
+      pos_ += static_cast<std::size_t>(std::countr_zero(special));
+    } else {
+      const char* p = scanner_->find_structural(data + pos_, end);
+      if (p == end) break;
+      pos_ = static_cast<std::size_t>(p - data);
+      if (*p != '#' && *p != '"') {
+        if (open >= room && *p == ':') {
+          fail(error_code::depth_limit, pos_);
+          return false;
+        }
+        if (delimiter(pos_++)) return true;
+        continue;
+      }
+    }
+
+    if (data[pos_] == '#') {
+      if (!skip_comment()) {
+        fail(error_code::unterminated_comment, pos_);
+        return false;
+      }
+      continue;
+    }
+    const char* p = data + pos_ + 1;
+    for (;;) {
+      p = scanner_->find_quote_end(p, end);
+      if (p == end || (*p == '\\' && end - p < 2)) {
+        fail(error_code::unterminated_quote, pos_);
+        return false;
+      }
+      if (*p == '"') break;
+      p += 2;
+    }
+    pos_ = static_cast<std::size_t>(p - data) + 1;
+  }
+  pos_ = input_.size();
+  return true;
+}
+
+inline token tokenizer::quoted_token() noexcept {
+  const char* const data = input_.data();
+  const char* const end = data + input_.size();
+  const std::size_t open = pos_;
+  std::uint8_t flags = token::quoted;
+  const char* p = data + open + 1;
+  for (;;) {
+    p = scanner_->find_quote_end(p, end);
+    if (p == end) return fail(error_code::unterminated_quote, open);
+    if (*p == '"') break;
+    if (end - p < 2) return fail(error_code::unterminated_quote, open);
+    if (detail::is_escapable(p[1])) flags |= token::escaped;
+    p += 2;
+  }
+
+  const auto close = static_cast<std::size_t>(p - data);
+  pos_ = close + 1;
+  after_text_ = true;
+  PAPR_STAT_ADD(tokens, 1);
+  PAPR_STAT_ADD(quoted_tokens, 1);
+  PAPR_STAT_ADD(escaped_tokens, (flags & token::escaped) ? 1 : 0);
+  return {token_kind::text, flags, input_.substr(open + 1, close - open - 1)};
+}
+
+inline token tokenizer::plain_token() noexcept {
+  const char* const data = input_.data();
+  const char* const end = data + input_.size();
+  const std::size_t start = pos_;
+  const char* hit = scanner_->find_structural(data + start, end);
+  const auto i = static_cast<std::size_t>(hit - data);
+  if (hit != end && *hit == '"') return fail(error_code::unexpected_quote, i);
+
+  std::size_t last = i;
+  while (last > start && detail::is_space(data[last - 1])) --last;
+  pos_ = i;
+  after_text_ = true;
+  PAPR_STAT_ADD(tokens, 1);
+  return {token_kind::text, 0, input_.substr(start, last - start)};
+}
+
+} // namespace papr
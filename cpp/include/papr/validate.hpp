@@ -0,0 +1,76 @@
+// papr - validate.hpp
+// Checking that input is well-formed papr without building a document.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "error.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// A place in the source for people: 1-based line and column, the column
+// counted in UTF-8 code points.
+struct text_position {
+  std::size_t line = 1;
+  std::size_t column = 1;
+};
+
+// Where byte `offset` of `input` falls, e.g. to report a status.
+inline text_position locate(std::string_view input, std::size_t offset) noexcept {
+  if (offset > input.size()) offset = input.size();
+  text_position at;
+  const char* p = input.data();
+  const char* const end = p + offset;
+  const char* line = p;
+  while (const void* eol = std::memchr(p, '\n', static_cast<std::size_t>(end - p))) {
+    p = static_cast<const char*>(eol) + 1;
+    line = p;
+    ++at.line;
+  }
+  for (; line < end; ++line) at.column += (static_cast<unsigned char>(*line) & 0xc0) != 0x80;
+  return at;
+}
+
+struct validation {
+  status st;
+  text_position position; // of st.offset; meaningless when st is ok
+
+  bool ok() const noexcept { return st.ok(); }
+};
+
+// Reports the error papr::parse would report for `input`, with the line and
+// column it is at, or success. Nothing is allocated and no tape is built:
+// the tokenizer runs over the input once with a depth counter beside it.
+inline validation validate(std::string_view input, backend scan = backend::automatic,
+                           std::uint32_t max_depth = default_max_depth) noexcept {
+  PAPR_TRACE_SCOPE("papr::validate");
+  const auto fail = [&](error_code code, std::size_t at) noexcept {
+    return validation{{code, at}, locate(input, at)};
+  };
+  tokenizer tok{input, scan};
+  std::uint32_t depth = 0;
+  for (token t = tok.next();; t = tok.next()) {
+    switch (t.kind) {
+      case token_kind::text: PAPR_STAT_MAX(max_depth, depth); break;
+      case token_kind::colon:
+        if (depth == max_depth) return fail(error_code::depth_limit, tok.position() - 1);
+        ++depth;
+        break;
+      case token_kind::comma: break;
+      case token_kind::semicolon:
+        if (depth == 0) return fail(error_code::depth_underflow, tok.position() - 1);
+        --depth;
+        break;
+      case token_kind::end: return {};
+      case token_kind::error: return fail(tok.error(), tok.error_offset());
+    }
+  }
+}
+
+} // namespace papr
@@ -0,0 +1,251 @@
+// papr - writer.hpp
+// Output sinks and the minifying serializer.
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "document.hpp"
+#include "error.hpp"
+#include "sax.hpp"
+#include "tokenizer.hpp"
+
+namespace papr {
+
+// Anything serialized output can be written to.
+template <class S>
+concept sink = requires(S& s, std::string_view bytes) { s.write(bytes); };
+
+// A growable contiguous output buffer.
+class output_buffer {
+public:
+  void write(std::string_view bytes) { data_.append(bytes); }
+  void write(char c) { data_.push_back(c); }
+  void reserve(std::size_t n) { data_.reserve(n); }
+  void clear() noexcept { data_.clear(); }
+
+  std::string_view view() const noexcept { return data_; }
+  std::size_t size() const noexcept { return data_.size(); }
+  std::string release() noexcept { return std::move(data_); }
+
+private:
+  std::string data_;
+};
+
+// Collects output as a list of views instead of copying it, for handing to
+// writev(). Every piece must stay alive until the list has been written;
+// pieces that continue the previous one in memory are merged.
+class scatter_list {
+public:
+  void write(std::string_view bytes) {
+    if (bytes.empty()) return;
+    total_ += bytes.size();
+    if (!parts_.empty()) {
+      std::string_view& last = parts_.back();
+      if (last.data() + last.size() == bytes.data()) {
+        last = {last.data(), last.size() + bytes.size()};
+        return;
+      }
+    }
+    parts_.push_back(bytes);
+  }
+  void clear() noexcept {
+    parts_.clear();
+    total_ = 0;
+  }
+
+  const std::vector<std::string_view>& parts() const noexcept { return parts_; }
+  std::size_t size() const noexcept { return total_; }
+
+#if !defined(_WIN32)
+  // Writes every piece to `fd` with as few writev calls as IOV_MAX allows.
+  status write_to(int fd) const {
+    std::vector<iovec> iov;
+    iov.reserve(std::min<std::size_t>(parts_.size(), IOV_MAX));
+    std::size_t i = 0, skip = 0;
+    while (i < parts_.size()) {
+      iov.clear();
+      for (std::size_t j = i; j < parts_.size() && iov.size() < IOV_MAX; ++j) {
+        const std::size_t from = j == i ? skip : 0;
+        iov.push_back({const_cast<char*>(parts_[j].data() + from), parts_[j].size() - from});
+      }
+      const ssize_t n = ::writev(fd, iov.data(), static_cast<int>(iov.size()));
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return {error_code::io_error, 0};
+      }
+      // Advance past what was written, which may end inside a piece.
+      auto left = static_cast<std::size_t>(n);
+      while (i < parts_.size() && left >= parts_[i].size() - skip) {
+        left -= parts_[i].size() - skip;
+        skip = 0;
+        ++i;
+      }
+      skip += left;
+    }
+    return {};
+  }
+#endif
+
+private:
+  std::vector<std::string_view> parts_;
+  std::size_t total_ = 0;
+};
+
+namespace detail {
+
+inline constexpr std::string_view semicolons =
+    ";;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;";
+
+template <sink Sink>
+void write_semicolons(Sink& out, std::uint64_t count) {
+  for (; count > semicolons.size(); count -= semicolons.size()) out.write(semicolons);
+  out.write(semicolons.substr(0, static_cast<std::size_t>(count)));
+}
+
+// The delimiter that takes the depth from `from` to `to` in the tape.
+template <sink Sink>
+void write_transition(Sink& out, std::uint32_t from, std::uint32_t to) {
+  if (to > from) out.write(":");
+  else if (to == from) out.write(",");
+  else write_semicolons(out, from - to);
+}
+
+} // namespace detail
+
+// Rule 4: a value can be written bare unless it is empty, has leading or
+// trailing whitespace, or contains a byte that would end or open a token.
+constexpr bool needs_quotes(std::string_view value) noexcept {
+  if (value.empty() || detail::is_space(value.front()) || detail::is_space(value.back()))
+    return true;
+  for (const char c : value)
+    if (c == ':' || c == ',' || c == ';' || c == '#' || c == '"') return true;
+  return false;
+}
+
+// Writes `value` as a token, quoting and escaping it only if it needs it.
+template <sink Sink>
+void write_token(Sink& out, std::string_view value) {
+  if (!needs_quotes(value)) {
+    out.write(value);
+    return;
+  }
+  out.write("\"");
+  std::size_t run = 0;
+  for (std::size_t i = 0; i < value.size(); ++i) {
+    if (value[i] != '"' && value[i] != '\\') continue;
+    out.write(value.substr(run, i - run));
+    out.write(value[i] == '"' ? "\\\"" : "\\\\");
+    run = i + 1;
+  }
+  out.write(value.substr(run));
+  out.write("\"");
+}
+
+namespace detail {
+
+// needs_quotes for the value of raw escaped text, without decoding it.
+constexpr bool unescaped_needs_quotes(std::string_view raw) noexcept {
+  char last = ' ';
+  for (std::size_t i = 0; i < raw.size(); ++i) {
+    char c = raw[i];
+    if (c == '\\' && i + 1 < raw.size() && is_escapable(raw[i + 1])) c = raw[++i];
+    if ((i == 0 && is_space(c)) || c == ':' || c == ',' || c == ';' || c == '#' || c == '"')
+      return true;
+    last = c;
+  }
+  return is_space(last);
+}
+
+} // namespace detail
+
+// Writes node `i` of `doc` as a token without decoding it into memory of its
+// own. A quoted token whose value does not need its quotes loses them; if it
+// has escapes, the value is written as the runs of source between them. A
+// token that needs its quotes keeps its quoted source text, which is already
+// valid.
+template <sink Sink>
+void write_node(Sink& out, const document& doc, std::size_t i) {
+  const std::string_view raw = doc.raw(i);
+  const std::uint32_t flags = doc[i].flags;
+  if (!(flags & node::quoted) || (!(flags & node::escaped) && !needs_quotes(raw))) {
+    out.write(raw);
+    return;
+  }
+  if ((flags & node::escaped) && !detail::unescaped_needs_quotes(raw)) {
+    // The value holds no `"`, so every escape is a `\\` that loses its first
+    // backslash.
+    std::size_t run = 0;
+    for (std::size_t c = 0; c < raw.size(); ++c) {
+      if (raw[c] != '\\' || c + 1 == raw.size() || !detail::is_escapable(raw[c + 1])) continue;
+      out.write(raw.substr(run, c - run));
+      run = ++c;
+    }
+    out.write(raw.substr(run));
+    return;
+  }
+  out.write("\"");
+  out.write(raw);
+  out.write("\"");
+}
+
+// Writes `doc` in minified form in one pass over the tape: no comments, no
+// insignificant whitespace, and the shortest delimiters that rebuild the same
+// depths. Every byte written is either a view of the source or a literal, so
+// this copies nothing into a scatter_list. The output is never longer than
+// the source it was parsed from.
+template <sink Sink>
+void minify(const document& doc, Sink& out) {
+  const std::span<const node> nodes = doc.nodes();
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    if (i > 0) detail::write_transition(out, nodes[i - 1].depth, nodes[i].depth);
+    write_node(out, doc, i);
+  }
+}
+
+inline std::string minify(const document& doc) {
+  output_buffer out;
+  out.reserve(doc.source().size());
+  minify(doc, out);
+  return out.release();
+}
+
+// A sax_handler that writes what it is fed in minified form, so text can be
+// minified straight from a stream_parser without building a document. Unlike
+// minify(document) it keeps every delimiter of the input, trailing `;`
+// included.
+template <sink Sink>
+class minify_handler {
+public:
+  explicit minify_handler(Sink& out) noexcept : out_(out) {}
+
+  void on_key(std::string_view key) { write_token(out_, key); }
+  void on_value(std::string_view value) { write_token(out_, value); }
+  void on_depth_up() { out_.write(":"); }
+  void on_sibling() { out_.write(","); }
+  void on_depth_down() { out_.write(";"); }
+
+private:
+  Sink& out_;
+};
+
+// Minifies papr text without building a document.
+inline status minify(std::string_view input, output_buffer& out) {
+  out.reserve(out.size() + input.size());
+  minify_handler<output_buffer> handler{out};
+  return parse_events(input, handler);
+}
+
+} // namespace papr
@@ -0,0 +1,85 @@
+// papr - stress.hpp
+// Shared pieces of the stress tests.
+//
+// Each test is a program that drives one of papr's concurrent parts from
+// several threads at once and checks what every thread saw. They are meant to
+// run under ThreadSanitizer, which also catches the races a check cannot.
+// From cpp/:
+//
+//   c++ -std=c++20 -g -O1 -fsanitize=thread -Iinclude stress/stress_batch.cpp
+//       -o stress_batch -pthread
+//
+// A test prints nothing and exits with status 0 when every check held. Runs
+// are seeded, so a failure repeats, but thread timing still varies from run
+// to run.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <papr/papr.hpp>
+
+// Fails the run when an invariant does not hold. Unlike assert it is never
+// compiled out.
+#define PAPR_STRESS_CHECK(cond)                                                 \
+  do {                                                                          \
+    if (!(cond)) {                                                              \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      std::abort();                                                             \
+    }                                                                           \
+  } while (0)
+
+namespace papr::stress {
+
+// A tiny deterministic generator, so a run is reproducible from its seed.
+class random {
+public:
+  explicit random(std::uint64_t seed) noexcept : state_(seed) {}
+
+  std::uint64_t next() noexcept { return papr::detail::mix(state_ += papr::detail::hash_k0); }
+  std::size_t below(std::size_t n) noexcept { return static_cast<std::size_t>(next() % n); }
+
+private:
+  std::uint64_t state_;
+};
+
+// A valid document of about `records` small records, each tagged with `tag`
+// so that documents can be told apart.
+inline std::string make_document(random& rng, std::size_t records, std::size_t tag) {
+  std::string text = "doc" + std::to_string(tag) + ": ";
+  for (std::size_t r = 0; r < records; ++r) {
+    text += std::to_string(r) + ": id: k" + std::to_string(rng.below(1000)) + "; ";
+    if (rng.below(2) == 0) text += "fn: \"f(\\\"x\\\")\"; ";
+    text += "icon: i" + std::to_string(rng.below(50)) + ";; ";
+  }
+  return text + ";";
+}
+
+// An input that fails to parse: a valid document with one of the errors of
+// the spec spliced into it.
+inline std::string make_malformed(random& rng, std::size_t records, std::size_t tag) {
+  std::string text = make_document(rng, records, tag);
+  switch (rng.below(3)) {
+    case 0: return text + ";";                      // closes more than it opened
+    case 1: return text + " \"open";                // a quote that never ends
+    default: return text + "## never closed";
+  }
+}
+
+// Two documents are the same when their tapes and token values match, wherever
+// the token text lives.
+inline bool same_tree(const document& a, const document& b) {
+  if (a.size() != b.size()) return false;
+  std::string sa, sb;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (a[i].depth != b[i].depth || a[i].next != b[i].next) return false;
+    if (a.value(i, sa) != b.value(i, sb)) return false;
+  }
+  return true;
+}
+
+} // namespace papr::stress
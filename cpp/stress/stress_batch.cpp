@@ -0,0 +1,66 @@
+// papr - stress_batch.cpp
+// Many batches through one batch_parser, whose workers deal out, take and
+// steal inputs: every result must be what papr::parse makes of the input at
+// its index, and an input that fails must fail on its own. See stress.hpp to
+// build it.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stress.hpp"
+
+namespace {
+
+void run(papr::stress::random& rng, bool extras) {
+  papr::batch_options options;
+  options.threads = 4;
+  options.index = extras;
+  options.intern = extras;
+  options.hashes = extras;
+  papr::batch_parser pool{options}; // reused by every batch below
+  PAPR_STRESS_CHECK(pool.threads() == 4);
+  std::size_t failures = 0;
+  for (int round = 0; round < 200; ++round) {
+    // Mostly small inputs and now and then a large one, so that workers run
+    // dry at different times and steal from each other; about one in four
+    // fails to parse.
+    const std::size_t count = rng.below(64);
+    std::vector<std::string> texts;
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::size_t records = rng.below(8) == 0 ? 200 + rng.below(400) : rng.below(8);
+      texts.push_back(rng.below(4) == 0 ? papr::stress::make_malformed(rng, records, i)
+                                        : papr::stress::make_document(rng, records, i));
+    }
+    const std::vector<std::string_view> inputs(texts.begin(), texts.end());
+    const std::span<const papr::batch_result> results = pool.parse_batch(inputs);
+    PAPR_STRESS_CHECK(results.size() == count);
+    for (std::size_t i = 0; i < count; ++i) {
+      papr::document expected;
+      const papr::status st = papr::parse(inputs[i], expected);
+      const papr::batch_result& r = results[i];
+      PAPR_STRESS_CHECK(r.st.code == st.code && r.st.offset == st.offset);
+      PAPR_STRESS_CHECK(papr::stress::same_tree(r.doc, expected));
+      if (!st.ok()) {
+        ++failures;
+        continue;
+      }
+      PAPR_STRESS_CHECK(r.doc.source().data() == inputs[i].data());
+      PAPR_STRESS_CHECK(r.doc.has_index() == extras && r.doc.is_interned() == extras &&
+                        r.doc.has_subtree_hashes() == extras);
+      PAPR_STRESS_CHECK(r.doc.find_child(papr::element::root_index,
+                                         "doc" + std::to_string(i)) == 0);
+    }
+  }
+  PAPR_STRESS_CHECK(failures > 0);
+}
+
+} // namespace
+
+int main() {
+  papr::stress::random rng{1};
+  run(rng, false);
+  run(rng, true);
+  return 0;
+}
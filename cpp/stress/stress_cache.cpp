@@ -0,0 +1,164 @@
+// papr - stress_cache.cpp
+// A document_cache under threads that ask for the same files at once while
+// one of them is replaced: every get() must return a whole document, threads
+// that miss together must share one parse, and a get() that starts after a
+// file was replaced must not return an older version. See stress.hpp to
+// build it.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stress.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void write_file(const fs::path& path, const std::string& text) {
+  std::FILE* f = std::fopen(path.string().c_str(), "wb");
+  PAPR_STRESS_CHECK(f != nullptr);
+  PAPR_STRESS_CHECK(std::fwrite(text.data(), 1, text.size(), f) == text.size());
+  PAPR_STRESS_CHECK(std::fclose(f) == 0);
+}
+
+// Dates the file back, so that its stamp is settled.
+void age(const fs::path& path) {
+  fs::last_write_time(path, fs::file_time_type::clock::now() - std::chrono::hours{1});
+}
+
+// Version n of the replaced file: "v: <n>;" and n bytes of padding, so that
+// no two versions have the same size.
+std::string version(std::uint64_t n) {
+  return "v: " + std::to_string(n) + "; pad: " + std::string(n + 1, 'x') + ";";
+}
+
+std::uint64_t version_of(const papr::cached_document& file) {
+  const papr::document& doc = file.doc();
+  PAPR_STRESS_CHECK(doc.size() == 4 && doc.value(0) == "v");
+  PAPR_STRESS_CHECK(doc.value(3).size() == std::stoull(std::string(doc.value(1))) + 1);
+  return std::stoull(std::string(doc.value(1)));
+}
+
+// A file rewritten in place with its size and modification time unchanged:
+// the stamp cannot tell, but a stamp that recent is checked against the
+// contents on the next get().
+void same_stamp(const fs::path& dir) {
+  papr::document_cache cache;
+  const fs::path path = dir / "same.papr";
+  write_file(path, version(1));
+  papr::document_cache::handle first, second;
+  PAPR_STRESS_CHECK(cache.get(path.string(), first).ok() && version_of(*first) == 1);
+  const fs::file_time_type written = fs::last_write_time(path);
+  write_file(path, version(1).replace(3, 1, "3")); // the same size
+  fs::last_write_time(path, written);
+  PAPR_STRESS_CHECK(cache.get(path.string(), second).ok());
+  PAPR_STRESS_CHECK(second->doc().value(1) == "3");
+
+  // Once settled, a hit is the same document, and equal contents share one.
+  age(path);
+  PAPR_STRESS_CHECK(cache.get(path.string(), first).ok());
+  PAPR_STRESS_CHECK(first == second);
+  PAPR_STRESS_CHECK(cache.get(path.string(), second).ok() && first == second);
+  const fs::path copy = dir / "copy.papr";
+  fs::copy_file(path, copy, fs::copy_options::overwrite_existing);
+  PAPR_STRESS_CHECK(cache.get(copy.string(), second).ok() && first == second);
+  PAPR_STRESS_CHECK(cache.size() == 2);
+  cache.erase(copy.string());
+  PAPR_STRESS_CHECK(cache.size() == 1);
+}
+
+// Threads that ask for an uncached file at once wait for one parse and all
+// get its document.
+void coalescing(const fs::path& dir) {
+  papr::stress::random rng{1};
+  const fs::path path = dir / "big.papr";
+  write_file(path, papr::stress::make_document(rng, 4000, 0));
+  age(path);
+  for (int round = 0; round < 20; ++round) {
+    papr::document_cache cache;
+    std::atomic<bool> go{false};
+    std::vector<papr::document_cache::handle> handles(6);
+    std::vector<std::thread> threads;
+    for (papr::document_cache::handle& h : handles)
+      threads.emplace_back([&cache, &go, &path, &h] {
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        PAPR_STRESS_CHECK(cache.get(path.string(), h).ok());
+      });
+    go.store(true, std::memory_order_release);
+    for (std::thread& t : threads) t.join();
+    for (const papr::document_cache::handle& h : handles) PAPR_STRESS_CHECK(h == handles[0]);
+    PAPR_STRESS_CHECK(handles[0]->doc().value(0) == "doc0");
+  }
+}
+
+// One file is renamed over by newer versions while readers get it and a
+// second, unchanging file.
+void replacement(const fs::path& dir) {
+  constexpr std::uint64_t versions = 300;
+  papr::document_cache cache;
+  const fs::path path = dir / "live.papr";
+  const fs::path staged = dir / "live.papr.tmp";
+  const fs::path still = dir / "still.papr";
+  write_file(path, version(0));
+  write_file(still, "still: here;");
+  age(still);
+  papr::document_cache::handle kept;
+  PAPR_STRESS_CHECK(cache.get(still.string(), kept).ok());
+
+  std::atomic<std::uint64_t> latest{0};
+  std::atomic<std::uint64_t> reads{0};
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 6; ++t) {
+    threads.emplace_back([&] {
+      std::uint64_t last = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        const std::uint64_t floor = latest.load(std::memory_order_acquire);
+        papr::document_cache::handle h;
+        PAPR_STRESS_CHECK(cache.get(path.string(), h).ok());
+        const std::uint64_t seen = version_of(*h);
+        PAPR_STRESS_CHECK(seen >= floor && seen >= last);
+        last = seen;
+        PAPR_STRESS_CHECK(cache.get(still.string(), h).ok() && h == kept);
+        reads.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  for (std::uint64_t n = 1, seen = 0; n <= versions; ++n) {
+    // Waits for some get to finish, so that they interleave with the
+    // renames even on a single core.
+    while (reads.load(std::memory_order_relaxed) == seen) std::this_thread::yield();
+    seen = reads.load(std::memory_order_relaxed);
+    write_file(staged, version(n));
+    fs::rename(staged, path);
+    latest.store(n, std::memory_order_release);
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : threads) t.join();
+
+  papr::document_cache::handle h;
+  PAPR_STRESS_CHECK(cache.get(path.string(), h).ok() && version_of(*h) == versions);
+  PAPR_STRESS_CHECK(cache.size() == 2);
+}
+
+} // namespace
+
+int main() {
+  const fs::path dir =
+      fs::temp_directory_path() / ("papr-stress-cache-" + std::to_string(std::random_device{}()));
+  fs::create_directories(dir);
+  same_stamp(dir);
+  coalescing(dir);
+  replacement(dir);
+  fs::remove_all(dir);
+  return 0;
+}
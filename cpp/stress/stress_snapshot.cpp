@@ -0,0 +1,124 @@
+// papr - stress_snapshot.cpp
+// Readers of a snapshot_handle racing a writer that keeps publishing, with
+// more readers than reader slots: every reader must see a whole snapshot,
+// never an older one than it saw before, and every replaced snapshot must be
+// freed once the readers are gone. See stress.hpp to build it.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "stress.hpp"
+
+namespace {
+
+constexpr std::size_t slots = 2;
+constexpr std::size_t readers = 8;
+constexpr std::uint64_t versions = 2000;
+
+// The writer tags version n "doc<n>", so a reader can tell whether the
+// document it holds is the one its version says.
+void check(const papr::snapshot& s) {
+  const papr::document& doc = s.doc();
+  PAPR_STRESS_CHECK(doc.size() > 0);
+  PAPR_STRESS_CHECK(doc.value(0) == "doc" + std::to_string(s.version()));
+  PAPR_STRESS_CHECK(doc.find_child(papr::element::root_index, doc.value(0)) == 0);
+  PAPR_STRESS_CHECK(s.text().substr(0, doc.value(0).size()) == doc.value(0));
+}
+
+// One reader held across publishes keeps every snapshot replaced since its
+// epoch: from the epoch alone a reader that marked it just before a swap
+// could hold either side of it.
+void pinned() {
+  papr::snapshot_handle handle{slots};
+  papr::snapshot_options options;
+  options.index = true;
+  PAPR_STRESS_CHECK(!handle.read());
+  PAPR_STRESS_CHECK(handle.publish("doc1: a: b;;", options).ok());
+  {
+    const papr::snapshot_handle::reader held = handle.read();
+    PAPR_STRESS_CHECK(handle.publish("doc2: a: b;;", options).ok());
+    PAPR_STRESS_CHECK(!handle.publish("doc3: a: b;;;", options).ok());
+    PAPR_STRESS_CHECK(handle.publish("doc3: a: b;;", options).ok());
+    handle.reclaim();
+    PAPR_STRESS_CHECK(handle.retired_count() == 2);
+    PAPR_STRESS_CHECK(held->version() == 1);
+    check(*held);
+    PAPR_STRESS_CHECK(handle.read()->version() == 3);
+  }
+  handle.reclaim();
+  PAPR_STRESS_CHECK(handle.retired_count() == 0);
+}
+
+void racing() {
+  papr::snapshot_handle handle{slots};
+  papr::snapshot_options options;
+  options.index = true;
+  std::atomic<bool> done{false};
+  std::atomic<std::uint64_t> reads{0};
+
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < readers; ++t) {
+    threads.emplace_back([&handle, &done, &reads, t] {
+      papr::stress::random rng{t + 100};
+      std::uint64_t last = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        const papr::snapshot_handle::reader r = handle.read();
+        if (!r) continue;
+        PAPR_STRESS_CHECK(r->version() >= last);
+        last = r->version();
+        check(*r);
+        // Hold the snapshot for a while, sometimes across publishes, and
+        // look again: it must not have been freed or changed meanwhile.
+        for (std::size_t spin = rng.below(256); spin > 0; --spin) std::this_thread::yield();
+        check(*r);
+        PAPR_STRESS_CHECK(r->version() == last);
+        reads.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  // Another thread frees what it can while the writer publishes.
+  threads.emplace_back([&handle, &done] {
+    while (!done.load(std::memory_order_acquire)) {
+      handle.reclaim();
+      std::this_thread::yield();
+    }
+  });
+
+  papr::stress::random rng{1};
+  for (std::uint64_t published = 0, seen = 0; published < versions;) {
+    // Waits for some read of a published snapshot to finish, so that
+    // publishes and reads interleave even on a single core.
+    while (published > 0 && reads.load(std::memory_order_relaxed) == seen)
+      std::this_thread::yield();
+    seen = reads.load(std::memory_order_relaxed);
+    // Now and then a publish fails and the current snapshot stays.
+    if (rng.below(8) == 0) {
+      const std::string text = papr::stress::make_malformed(rng, rng.below(8), published + 1);
+      if (!handle.publish(text, options).ok()) continue;
+    } else {
+      const std::string text = papr::stress::make_document(rng, rng.below(8), published + 1);
+      PAPR_STRESS_CHECK(handle.publish(text, options).ok());
+    }
+    ++published;
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : threads) t.join();
+
+  PAPR_STRESS_CHECK(handle.read()->version() == versions);
+  handle.reclaim();
+  PAPR_STRESS_CHECK(handle.retired_count() == 0);
+}
+
+} // namespace
+
+int main() {
+  pinned();
+  racing();
+  return 0;
+}